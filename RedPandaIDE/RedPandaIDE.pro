@@ -33,6 +33,7 @@ SOURCES += \
     compiler/filecompiler.cpp \
     compiler/stdincompiler.cpp \
     cpprefacter.cpp \
+    filesearcher.cpp \
     parser/cppparser.cpp \
     parser/cpppreprocessor.cpp \
     parser/cpptokenizer.cpp \
@@ -155,6 +156,7 @@ HEADERS += \
     compiler/runner.h \
     compiler/stdincompiler.h \
     cpprefacter.h \
+    filesearcher.h \
     gdbmiresultparser.h \
     parser/cppparser.h \
     parser/cpppreprocessor.h \
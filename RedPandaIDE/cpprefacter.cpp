@@ -19,17 +19,105 @@
 #include "settings.h"
 #include "editor.h"
 #include "editorlist.h"
+#include <QElapsedTimer>
 #include <QFile>
 #include <QMessageBox>
 #include <QTextCodec>
-#include "HighlighterManager.h"
 #include "project.h"
+#include "qsynedit/TextBuffer.h"
 
-CppRefacter::CppRefacter(QObject *parent) : QObject(parent)
+static SymbolReferenceList findReferencesInFile(
+        const QString &filename,
+        const QStringList &contents,
+        const PStatement &statement,
+        const PCppParser &parser)
+{
+    SymbolReferenceList references;
+    bool indexed = parser->findSymbolReferences(filename,contents,statement,references);
+    // the index is outdated if any reference doesn't match the contents
+    foreach (const SymbolReference& reference, references) {
+        if (reference.line<1 || reference.line>contents.count()
+                || contents[reference.line-1].mid(reference.start-1,statement->command.length())!=statement->command) {
+            indexed = false;
+            break;
+        }
+    }
+    if (!indexed) {
+        // the file is not indexed by the parser, or is changed after last parse,
+        // so collect the references from the contents by ourself
+        references.clear();
+        SymbolReferenceIndex index;
+        collectSymbolReferences(contents,index);
+        foreach (const SymbolReference& reference, index.references.value(statement->command)) {
+            PStatement tokenStatement = parser->findStatementOf(
+                        filename,
+                        index.expressions[reference.expressionId], reference.line);
+            if (tokenStatement
+                    && (tokenStatement->line == statement->line)
+                    && (tokenStatement->fileName == statement->fileName)) {
+                references.append(reference);
+            }
+        }
+    }
+    return references;
+}
+
+OccurenceSearchThread::OccurenceSearchThread(POccurenceSearchTask task, QObject *parent):
+    QThread(parent),
+    mTask(task)
+{
+
+}
+
+void OccurenceSearchThread::run()
+{
+    PSearchResultTreeItemList items = std::make_shared<SearchResultTreeItemList>();
+    QElapsedTimer timer;
+    timer.start();
+    while (!mTask->stop) {
+        QString filename;
+        {
+            QMutexLocker locker(&mTask->mutex);
+            if (mTask->nextFile>=mTask->files.count())
+                break;
+            filename = mTask->files[mTask->nextFile];
+            mTask->nextFile++;
+        }
+        QStringList contents;
+        if (mTask->openedContents.contains(filename)) {
+            contents = mTask->openedContents.value(filename);
+        } else if (!readTextFileToLines(filename,ENCODING_AUTO_DETECT,contents)) {
+            continue;
+        }
+        PSearchResultTreeItem item = CppRefacter::findOccurenceInFile(
+                    filename,
+                    contents,
+                    mTask->statement,
+                    mTask->parser);
+        if (!item->results.isEmpty())
+            items->append(item);
+        // send results in batches, so the result view won't be reset too often
+        if (!items->isEmpty() && timer.elapsed()>=100) {
+            emit occurencesFound(items);
+            items = std::make_shared<SearchResultTreeItemList>();
+            timer.restart();
+        }
+    }
+    if (!items->isEmpty())
+        emit occurencesFound(items);
+}
+
+CppRefacter::CppRefacter(QObject *parent) : QObject(parent),
+    mRunningThreads(0)
 {
 
 }
 
+CppRefacter::~CppRefacter()
+{
+    cancelFindOccurence();
+}
+
 bool CppRefacter::findOccurence(Editor *editor, const BufferCoord &pos)
 {
     if (!editor->parser())
@@ -98,6 +186,11 @@ bool CppRefacter::findOccurence(const QString &statementFullname, SearchFileScop
     }
 }
 
+bool CppRefacter::searching() const
+{
+    return mTask!=nullptr;
+}
+
 static QString fullParentName(PStatement statement) {
     PStatement parent = statement->parentScope.lock();
     if (parent) {
@@ -148,6 +241,67 @@ void CppRefacter::renameSymbol(Editor *editor, const BufferCoord &pos, const QSt
     renameSymbolInFile(editor->filename(),oldStatement,newWord, editor->parser());
 }
 
+void CppRefacter::stopFindOccurence()
+{
+    if (!mTask)
+        return;
+    cancelFindOccurence();
+    emit searchFinished();
+}
+
+void CppRefacter::cancelFindOccurence()
+{
+    if (!mTask)
+        return;
+    mTask->stop = true;
+    foreach (QObject* child, children()) {
+        OccurenceSearchThread* thread = qobject_cast<OccurenceSearchThread*>(child);
+        if (thread) {
+            thread->wait();
+            thread->setParent(nullptr);
+            thread->deleteLater();
+        }
+    }
+    mTask->parser->unFreeze();
+    mTask.reset();
+    mResults.reset();
+    mRunningThreads = 0;
+}
+
+void CppRefacter::onOccurencesFound(PSearchResultTreeItemList items)
+{
+    // results from a stopped search
+    if (!mResults || sender()==nullptr || sender()->parent()!=this)
+        return;
+    mResults->results.append(*items);
+    pMainWindow->searchResultModel()->notifySearchResultsUpdated();
+}
+
+void CppRefacter::onSearchThreadFinished()
+{
+    OccurenceSearchThread* thread = qobject_cast<OccurenceSearchThread*>(sender());
+    if (!thread || thread->parent()!=this)
+        return;
+    thread->setParent(nullptr);
+    thread->deleteLater();
+    mRunningThreads--;
+    if (mRunningThreads>0)
+        return;
+    // keep the same order as the project units
+    QHash<QString,int> fileOrders;
+    for (int i=0;i<mTask->files.count();i++)
+        fileOrders.insert(mTask->files[i],i);
+    std::sort(mResults->results.begin(),mResults->results.end(),
+              [&fileOrders](const PSearchResultTreeItem& item1, const PSearchResultTreeItem& item2){
+        return fileOrders.value(item1->filename) < fileOrders.value(item2->filename);
+    });
+    mTask->parser->unFreeze();
+    mTask.reset();
+    mResults.reset();
+    pMainWindow->searchResultModel()->notifySearchResultsUpdated();
+    emit searchFinished();
+}
+
 void CppRefacter::doFindOccurenceInEditor(PStatement statement , Editor *editor, const PCppParser &parser)
 {
     PSearchResults results = pMainWindow->searchResultModel()->addSearchResults(
@@ -157,6 +311,7 @@ void CppRefacter::doFindOccurenceInEditor(PStatement statement , Editor *editor,
                 );
     PSearchResultTreeItem item = findOccurenceInFile(
                 editor->filename(),
+                editor->contents(),
                 statement,
                 parser);
     if (item && !(item->results.isEmpty())) {
@@ -166,143 +321,78 @@ void CppRefacter::doFindOccurenceInEditor(PStatement statement , Editor *editor,
 
 void CppRefacter::doFindOccurenceInProject(PStatement statement, std::shared_ptr<Project> project, const PCppParser &parser)
 {
-    PSearchResults results = pMainWindow->searchResultModel()->addSearchResults(
+    cancelFindOccurence();
+    mResults = pMainWindow->searchResultModel()->addSearchResults(
                 statement->command,
                 statement->fullName,
                 SearchFileScope::wholeProject
                 );
+    mTask = std::make_shared<OccurenceSearchTask>();
+    mTask->statement = statement;
+    mTask->parser = parser;
+    mTask->nextFile = 0;
+    mTask->stop = false;
     foreach (const PProjectUnit& unit, project->units()) {
         if (isCfile(unit->fileName()) || isHfile(unit->fileName())) {
-            PSearchResultTreeItem item = findOccurenceInFile(
-                        unit->fileName(),
-                        statement,
-                        parser);
-            if (item && !(item->results.isEmpty())) {
-                results->results.append(item);
-            }
+            mTask->files.append(unit->fileName());
+            // editors can only be accessed in the gui thread
+            QStringList buffer;
+            if (pMainWindow->editorList()->getContentFromOpenedEditor(unit->fileName(),buffer))
+                mTask->openedContents.insert(unit->fileName(),buffer);
         }
     }
+    // the parser is unfreezed when all search threads are finished
+    parser->freeze();
+    mRunningThreads = std::max(1,std::min(QThread::idealThreadCount(),mTask->files.count()));
+    for (int i=0;i<mRunningThreads;i++) {
+        OccurenceSearchThread* thread = new OccurenceSearchThread(mTask,this);
+        connect(thread, &OccurenceSearchThread::occurencesFound,
+                this, &CppRefacter::onOccurencesFound);
+        connect(thread, &QThread::finished,
+                this, &CppRefacter::onSearchThreadFinished);
+        thread->start();
+    }
+    emit searchStarted();
 }
 
 PSearchResultTreeItem CppRefacter::findOccurenceInFile(
         const QString &filename,
+        const QStringList &contents,
         const PStatement &statement,
         const PCppParser& parser)
 {
     PSearchResultTreeItem parentItem = std::make_shared<SearchResultTreeItem>();
     parentItem->filename = filename;
     parentItem->parent = nullptr;
-    QStringList buffer;
-    Editor editor(nullptr);
-    if (pMainWindow->editorList()->getContentFromOpenedEditor(
-                filename,buffer)){
-        editor.lines()->setContents(buffer);
-    } else {
-        QByteArray encoding;
-        editor.lines()->loadFromFile(filename,ENCODING_AUTO_DETECT,encoding);
-    }
-    editor.setHighlighter(HighlighterManager().getCppHighlighter());
-    int posY = 0;
-    while (posY < editor.lines()->count()) {
-        QString line = editor.lines()->getString(posY);
-        if (line.isEmpty()) {
-            posY++;
-            continue;
-        }
-
-        if (posY == 0) {
-            editor.highlighter()->resetState();
-        } else {
-            editor.highlighter()->setState(
-                        editor.lines()->ranges(posY-1));
-        }
-        editor.highlighter()->setLine(line,posY);
-        while (!editor.highlighter()->eol()) {
-            int start = editor.highlighter()->getTokenPos() + 1;
-            QString token = editor.highlighter()->getToken();
-            PSynHighlighterAttribute attr = editor.highlighter()->getTokenAttribute();
-            if (!attr || attr!=editor.highlighter()->commentAttribute()) {
-                if (token == statement->command) {
-                    //same name symbol , test if the same statement;
-                    BufferCoord p;
-                    p.Line = posY+1;
-                    p.Char = start+1;
-
-                    QStringList expression = editor.getExpressionAtPosition(p);
-                    PStatement tokenStatement = parser->findStatementOf(
-                                filename,
-                                expression, p.Line);
-                    if (tokenStatement
-                            && (tokenStatement->line == statement->line)
-                            && (tokenStatement->fileName == statement->fileName)) {
-                        PSearchResultTreeItem item = std::make_shared<SearchResultTreeItem>();
-                        item->filename = filename;
-                        item->line = p.Line;
-                        item->start = start;
-                        item->len = token.length();
-                        item->parent = parentItem.get();
-                        item->text = line;
-                        item->text.replace('\t',' ');
-                        parentItem->results.append(item);
-                    }
-                }
-            }
-            editor.highlighter()->next();
-        }
-        posY++;
+    SymbolReferenceList references = findReferencesInFile(filename,contents,statement,parser);
+    foreach (const SymbolReference& reference, references) {
+        PSearchResultTreeItem item = std::make_shared<SearchResultTreeItem>();
+        item->filename = filename;
+        item->line = reference.line;
+        item->start = reference.start;
+        item->len = statement->command.length();
+        item->parent = parentItem.get();
+        item->text = contents[reference.line-1];
+        item->text.replace('\t',' ');
+        parentItem->results.append(item);
     }
     return parentItem;
 }
 
 void CppRefacter::renameSymbolInFile(const QString &filename, const PStatement &statement,  const QString &newWord, const PCppParser &parser)
 {
-    QStringList buffer;
-    Editor editor(nullptr);
-    if (pMainWindow->editorList()->getContentFromOpenedEditor(
-                filename,buffer)){
-        editor.lines()->setContents(buffer);
-    } else {
-        QByteArray encoding;
-        editor.lines()->loadFromFile(filename,ENCODING_AUTO_DETECT,encoding);
+    QStringList contents;
+    if (!pMainWindow->editorList()->getContentFromOpenedEditor(
+                filename,contents)){
+        if (!readTextFileToLines(filename,ENCODING_AUTO_DETECT,contents))
+            return;
     }
-    QStringList newContents;
-    editor.setHighlighter(HighlighterManager().getCppHighlighter());
-    int posY = 0;
-    while (posY < editor.lines()->count()) {
-        QString line = editor.lines()->getString(posY);
-
-        if (posY == 0) {
-            editor.highlighter()->resetState();
-        } else {
-            editor.highlighter()->setState(
-                        editor.lines()->ranges(posY-1));
-        }
-        editor.highlighter()->setLine(line,posY);
-        QString newLine;
-        while (!editor.highlighter()->eol()) {
-            int start = editor.highlighter()->getTokenPos() + 1;
-            QString token = editor.highlighter()->getToken();
-            if (token == statement->command) {
-                //same name symbol , test if the same statement;
-                BufferCoord p;
-                p.Line = posY+1;
-                p.Char = start+1;
-
-                QStringList expression = editor.getExpressionAtPosition(p);
-                PStatement tokenStatement = parser->findStatementOf(
-                            filename,
-                            expression, p.Line);
-                if (tokenStatement
-                        && (tokenStatement->line == statement->line)
-                        && (tokenStatement->fileName == statement->fileName)) {
-                    token = newWord;
-                }
-            }
-            newLine += token;
-            editor.highlighter()->next();
-        }
-        newContents.append(newLine);
-        posY++;
+    QStringList newContents = contents;
+    SymbolReferenceList references = findReferencesInFile(filename,contents,statement,parser);
+    // replace from the last one, so the positions of the former references are still valid
+    for (int i=references.count()-1;i>=0;i--) {
+        const SymbolReference& reference = references[i];
+        newContents[reference.line-1].replace(reference.start-1,statement->command.length(),newWord);
     }
 
     Editor * oldEditor = pMainWindow->editorList()->getOpenedEditorByFilename(filename);
@@ -310,9 +400,11 @@ void CppRefacter::renameSymbolInFile(const QString &filename, const PStatement &
         oldEditor->selectAll();
         oldEditor->setSelText(newContents.join(oldEditor->lineBreak()));
     } else {
+        SynEditStringList lines(nullptr);
+        lines.setContents(newContents);
         QByteArray realEncoding;
         QFile file(filename);
-        editor.lines()->saveToFile(file,ENCODING_AUTO_DETECT,
+        lines.saveToFile(file,ENCODING_AUTO_DETECT,
                                    pSettings->editor().useUTF8ByDefault()? ENCODING_UTF8 : QTextCodec::codecForLocale()->name(),
                                    realEncoding);
     }
@@ -18,6 +18,9 @@
 #define CPPREFACTER_H
 
 #include <QObject>
+#include <QMutex>
+#include <QThread>
+#include <atomic>
 #include "parser/parserutils.h"
 #include "widgets/searchresultview.h"
 #include "parser/cppparser.h"
@@ -25,28 +28,72 @@
 class Editor;
 class BufferCoord;
 class Project;
+
+// files to be searched by the occurence search threads, shared between them
+struct OccurenceSearchTask {
+    PStatement statement;
+    PCppParser parser;
+    QStringList files;
+    QHash<QString,QStringList> openedContents; // contents of the files opened in editors
+    int nextFile;
+    QMutex mutex;
+    std::atomic<bool> stop;
+};
+using POccurenceSearchTask = std::shared_ptr<OccurenceSearchTask>;
+
+class OccurenceSearchThread : public QThread
+{
+    Q_OBJECT
+public:
+    explicit OccurenceSearchThread(POccurenceSearchTask task, QObject *parent = nullptr);
+signals:
+    void occurencesFound(PSearchResultTreeItemList items);
+private:
+    POccurenceSearchTask mTask;
+    // QThread interface
+protected:
+    void run() override;
+};
+
 class CppRefacter : public QObject
 {
     Q_OBJECT
 public:
     explicit CppRefacter(QObject *parent = nullptr);
+    ~CppRefacter();
 
     bool findOccurence(Editor * editor, const BufferCoord& pos);
     bool findOccurence(const QString& statementFullname, SearchFileScope scope);
+    bool searching() const;
 
     void renameSymbol(Editor* editor, const BufferCoord& pos, const QString& word, const QString& newWord);
-private:
-    void doFindOccurenceInEditor(PStatement statement, Editor* editor, const PCppParser& parser);
-    void doFindOccurenceInProject(PStatement statement, std::shared_ptr<Project> project, const PCppParser& parser);
-    PSearchResultTreeItem findOccurenceInFile(
+
+    static PSearchResultTreeItem findOccurenceInFile(
             const QString& filename,
+            const QStringList& contents,
             const PStatement& statement,
             const PCppParser& parser);
+signals:
+    void searchStarted();
+    void searchFinished();
+public slots:
+    void stopFindOccurence();
+private slots:
+    void onOccurencesFound(PSearchResultTreeItemList items);
+    void onSearchThreadFinished();
+private:
+    void cancelFindOccurence();
+    void doFindOccurenceInEditor(PStatement statement, Editor* editor, const PCppParser& parser);
+    void doFindOccurenceInProject(PStatement statement, std::shared_ptr<Project> project, const PCppParser& parser);
     void renameSymbolInFile(
             const QString& filename,
             const PStatement& statement,
             const QString& newWord,
             const PCppParser& parser);
+private:
+    POccurenceSearchTask mTask;
+    PSearchResults mResults;
+    int mRunningThreads;
 };
 
 #endif // CPPREFACTER_H
@@ -24,6 +24,7 @@
 #include <memory>
 #include "settings.h"
 #include "mainwindow.h"
+#include "filesearcher.h"
 #include "systemconsts.h"
 #include <QFileDialog>
 #include <QMessageBox>
@@ -43,6 +44,8 @@
 #include <QPrinter>
 #include <QPrintDialog>
 #include <QTextDocument>
+#include <QTimer>
+#include <QElapsedTimer>
 #include <QTextCodec>
 #include "iconsmanager.h"
 #include "debugger.h"
@@ -96,6 +99,19 @@ Editor::Editor(QWidget *parent, const QString& filename,
 {
     mCurrentLineModified = false;
     mUseCppSyntax = pSettings->editor().defaultFileCpp();
+    mStatementKindsTimer = new QTimer(this);
+    mStatementKindsTimer->setSingleShot(true);
+    connect(mStatementKindsTimer, &QTimer::timeout,
+            this, &Editor::onResolveStatementKinds);
+    // a big file is read from its mapping, reload it when it's truncated by another program
+    connect(lines().get(), &SynEditStringList::mappedFileShrunk,
+            this, [this](){
+        try {
+            loadFile();
+        } catch(FileError e) {
+            QMessageBox::critical(this,tr("Error"),e.reason());
+        }
+    });
     if (mFilename.isEmpty()) {
         mFilename = tr("untitled")+QString("%1").arg(getNewFileNumber());
     }
@@ -119,7 +135,8 @@ Editor::Editor(QWidget *parent, const QString& filename,
 
     if (highlighter) {
         setHighlighter(highlighter);
-        setUseCodeFolding(true);
+        //folding needs the ranges of the whole file
+        setUseCodeFolding(!lines()->mapped());
     } else {
         setUseCodeFolding(false);
     }
@@ -137,6 +154,11 @@ Editor::Editor(QWidget *parent, const QString& filename,
         updateCaption();
     }
 
+    if (lines()->mapped()) {
+        setReadOnly(true);
+        updateCaption();
+    }
+
     mCompletionPopup = pMainWindow->completionPopup();
     mHeaderCompletionPopup = pMainWindow->headerCompletionPopup();
 
@@ -195,9 +217,13 @@ Editor::~Editor() {
 
 void Editor::loadFile(QString filename) {
     if (filename.isEmpty()) {
-        this->lines()->loadFromFile(mFilename,mEncodingOption,mFileEncoding);
+        filename = mFilename;
     } else {
         filename = QFileInfo(filename).absoluteFilePath();
+    }
+    if (QFileInfo(filename).size() > LARGE_FILE_SIZE_THRESHOLD) {
+        this->lines()->loadFromMappedFile(filename,mEncodingOption,mFileEncoding);
+    } else {
         this->lines()->loadFromFile(filename,mEncodingOption,mFileEncoding);
     }
     //this->setModified(false);
@@ -213,7 +239,7 @@ void Editor::loadFile(QString filename) {
     default:
         mUseCppSyntax = pSettings->editor().defaultFileCpp();
     }
-    if (highlighter() && mParser) {
+    if (highlighter() && mParser && !lines()->mapped()) {
         reparse();
         if (pSettings->editor().syntaxCheckWhenLineChanged()) {
             checkSyntaxInBack();
@@ -229,6 +255,7 @@ void Editor::saveFile(QString filename) {
                               pSettings->editor().useUTF8ByDefault()? ENCODING_UTF8 : QTextCodec::codecForLocale()->name(),
                               mFileEncoding);
     pMainWindow->updateForEncodingInfo();
+    pMainWindow->fileSearcher()->updateIndexedFile(filename);
 }
 
 void Editor::convertToEncoding(const QByteArray &encoding)
@@ -402,6 +429,7 @@ void Editor::setEncodingOption(const QByteArray& encoding) noexcept{
             if (index>=0) {
                 PProjectUnit unit = project->units()[index];
                 unit->setEncoding(mEncodingOption);
+                pMainWindow->fileSearcher()->updateIndexEncodings();
             }
         }
     }
@@ -893,24 +921,18 @@ void Editor::onPreparePaintHighlightToken(int line, int aChar, const QString &to
         return;
 
     if (mParser && highlighter() && (attr == highlighter()->identifierAttribute())) {
-        BufferCoord p{aChar,line};
-        BufferCoord pBeginPos,pEndPos;
-        QString s= getWordAtPosition(this,p, pBeginPos,pEndPos, WordPurpose::wpInformation);
-//        qDebug()<<s;
-        PStatement statement = mParser->findStatementOf(mFilename,
-          s , p.Line);
-        StatementKind kind = mParser->getKindOfStatement(statement);
-        if (kind == StatementKind::skUnknown) {
-            if ((pEndPos.Line>=1)
-              && (pEndPos.Char>=0)
-              && (pEndPos.Char < lines()->getString(pEndPos.Line-1).length())
-              && (lines()->getString(pEndPos.Line-1)[pEndPos.Char] == '(')) {
-                kind = StatementKind::skFunction;
-            } else {
-                kind = StatementKind::skVariable;
-            }
+        //kinds are resolved by the parser in background, painting only reads them
+        PLineStatementKinds lineKinds = mStatementKinds.value(line);
+        if (!lineKinds || lineKinds->text != lines()->getString(line-1)) {
+            lineKinds.reset();
+            scheduleResolveStatementKinds();
+        } else if (lineKinds->parserSerialId != mParser->serialId()) {
+            //use the old kinds until they are resolved again
+            scheduleResolveStatementKinds();
         }
-        PColorSchemeItem item = mStatementColors->value(kind,PColorSchemeItem());
+        PColorSchemeItem item;
+        if (lineKinds)
+            item = mStatementColors->value(lineKinds->kinds.value(aChar,StatementKind::skVariable),PColorSchemeItem());
 
         if (item) {
             foreground = item->foreground();
@@ -924,18 +946,9 @@ void Editor::onPreparePaintHighlightToken(int line, int aChar, const QString &to
         }
     }
 
-    //selection
+    //matching braces, the occurrences of the current word are painted as highlighted matches
     if (highlighter() && attr) {
-        if (((attr == highlighter()->identifierAttribute())
-                || (attr == highlighter()->keywordAttribute())
-                || (attr->name() == SYNS_AttrPreprocessor)
-                )
-            && (token == mCurrentHighlightedWord)) {
-            if (mCurrentHighlighWordForeground.isValid())
-                foreground = mCurrentHighlighWordForeground;
-            if (mCurrentHighlighWordBackground.isValid())
-                background = mCurrentHighlighWordBackground;
-        } else if (!selAvail() && attr->name() == SYNS_AttrSymbol
+        if (!selAvail() && attr->name() == SYNS_AttrSymbol
                    && pSettings->editor().highlightMathingBraces()) {
             //        qDebug()<<line<<":"<<aChar<<" - "<<mHighlightCharPos1.Line<<":"<<mHighlightCharPos1.Char<<" - "<<mHighlightCharPos2.Line<<":"<<mHighlightCharPos2.Char;
             if ( (line == mHighlightCharPos1.Line)
@@ -953,13 +966,6 @@ void Editor::onPreparePaintHighlightToken(int line, int aChar, const QString &to
                     background = mCurrentHighlighWordBackground;
             }
         }
-    } else {
-        if (token == mCurrentHighlightedWord) {
-            if (mCurrentHighlighWordForeground.isValid())
-                foreground = mCurrentHighlighWordForeground;
-            if (mCurrentHighlighWordBackground.isValid())
-                background = mCurrentHighlighWordBackground;
-        }
     }
 }
 
@@ -1500,7 +1506,11 @@ void Editor::onStatusChanged(SynStatusChanges changes)
         }
 
         if (mOldHighlightedWord != mCurrentHighlightedWord) {
-            invalidate();
+            //only the identifiers, keywords and preprocessor directives, not the words in comments or strings
+            setMatchHighlight(mCurrentHighlightedWord, ssoMatchCase | ssoWholeWord,
+                              {SynHighlighterTokenType::Identifier,
+                               SynHighlighterTokenType::Keyword,
+                               SynHighlighterTokenType::PreprocessDirective});
             mOldHighlightedWord = mCurrentHighlightedWord;
         }
         pMainWindow->updateStatusbarForLineCol();
@@ -1547,6 +1557,87 @@ void Editor::onTipEvalValueReady(const QString& value)
                this, &Editor::onTipEvalValueReady);
 }
 
+void Editor::onResolveStatementKinds()
+{
+    if (!mParser || !highlighter())
+        return;
+    if (mParser->parsing()) {
+        mStatementKindsTimer->start(100);
+        return;
+    }
+    int firstVisible = rowToLine(topLine());
+    int lastVisible = std::min(lines()->count(), rowToLine(topLine()+linesInWindow()));
+    //also resolve the lines a page above and below the window, for scrolling
+    int first = std::max(1, firstVisible - linesInWindow());
+    int last = std::min(lines()->count(), lastVisible + linesInWindow());
+    QString serialId = mParser->serialId();
+    //the visible lines first, then the ones below and above them
+    QVector<int> order;
+    for (int line=firstVisible;line<=last;line++)
+        order.append(line);
+    for (int line=firstVisible-1;line>=first;line--)
+        order.append(line);
+    QElapsedTimer timer;
+    timer.start();
+    foreach (int line, order) {
+        PLineStatementKinds lineKinds = mStatementKinds.value(line);
+        if (lineKinds
+                && lineKinds->parserSerialId == serialId
+                && lineKinds->text == lines()->getString(line-1))
+            continue;
+        if (timer.elapsed() >= 20) {
+            mStatementKindsTimer->start(0);
+            return;
+        }
+        resolveStatementKinds(line);
+        if (line>=firstVisible && line<=lastVisible)
+            invalidateLine(line);
+    }
+    //forget the lines far from the window
+    for (auto it=mStatementKinds.begin();it!=mStatementKinds.end();) {
+        if (it.key()<first || it.key()>last)
+            it = mStatementKinds.erase(it);
+        else
+            ++it;
+    }
+}
+
+void Editor::resolveStatementKinds(int line)
+{
+    PLineStatementKinds lineKinds = std::make_shared<LineStatementKinds>();
+    lineKinds->text = lines()->getString(line-1);
+    lineKinds->parserSerialId = mParser->serialId();
+    PSynEditLineTokens tokens = lineTokens(line-1);
+    foreach (const SynEditLineToken& token, tokens->tokens) {
+        if (token.attr != highlighter()->identifierAttribute())
+            continue;
+        BufferCoord p{token.pos+1,line};
+        BufferCoord pBeginPos,pEndPos;
+        QString s= getWordAtPosition(this,p, pBeginPos,pEndPos, WordPurpose::wpInformation);
+        PStatement statement = mParser->findStatementOf(mFilename,
+          s , p.Line);
+        StatementKind kind = mParser->getKindOfStatement(statement);
+        if (kind == StatementKind::skUnknown) {
+            if ((pEndPos.Line>=1)
+              && (pEndPos.Char>=0)
+              && (pEndPos.Char < lines()->getString(pEndPos.Line-1).length())
+              && (lines()->getString(pEndPos.Line-1)[pEndPos.Char] == '(')) {
+                kind = StatementKind::skFunction;
+            } else {
+                kind = StatementKind::skVariable;
+            }
+        }
+        lineKinds->kinds.insert(token.pos+1,kind);
+    }
+    mStatementKinds.insert(line,lineKinds);
+}
+
+void Editor::scheduleResolveStatementKinds()
+{
+    if (!mStatementKindsTimer->isActive())
+        mStatementKindsTimer->start(0);
+}
+
 void Editor::onLinesDeleted(int first, int count)
 {
     pMainWindow->caretList().linesDeleted(this,first,count);
@@ -1658,8 +1749,7 @@ QStringList Editor::getExpressionAtPosition(
         return result;
     int line = pos.Line-1;
     int ch = pos.Char-1;
-    int symbolMatchingLevel = 0;
-    LastSymbolType lastSymbolType=LastSymbolType::None;
+    ExpressionMatchState state;
     PSynHighlighter highlighter = highlighterManager.getHighlighter(mFilename);
     if (!highlighter)
         return result;
@@ -1694,173 +1784,8 @@ QStringList Editor::getExpressionAtPosition(
             highlighter->next();
         }
         for (int i=tokens.count()-1;i>=0;i--) {
-            QString token = tokens[i];
-            switch(lastSymbolType) {
-            case LastSymbolType::ScopeResolutionOperator: //before '::'
-                if (token==">") {
-                    lastSymbolType=LastSymbolType::MatchingAngleQuotation;
-                    symbolMatchingLevel=0;
-                } else if (isIdentChar(token.front())) {
-                    lastSymbolType=LastSymbolType::Identifier;
-                } else
-                    return result;
-                break;
-            case LastSymbolType::ObjectMemberOperator: //before '.'
-            case LastSymbolType::PointerMemberOperator: //before '->'
-            case LastSymbolType::PointerToMemberOfObjectOperator: //before '.*'
-            case LastSymbolType::PointerToMemberOfPointerOperator: //before '->*'
-                if (token == ")" ) {
-                    lastSymbolType=LastSymbolType::MatchingParenthesis;
-                    symbolMatchingLevel = 0;
-                } else if (token == "]") {
-                    lastSymbolType=LastSymbolType::MatchingBracket;
-                    symbolMatchingLevel = 0;
-                } else if (isIdentChar(token.front())) {
-                    lastSymbolType=LastSymbolType::Identifier;
-                } else
-                    return result;
-                break;
-            case LastSymbolType::AsteriskSign: // before '*':
-                if (token == '*') {
-
-                } else
-                    return result;
-                break;
-            case LastSymbolType::AmpersandSign: // before '&':
+            if (!prependExpressionToken(tokens[i],state,result))
                 return result;
-                break;
-            case LastSymbolType::ParenthesisMatched: //before '()'
-//                if (token == ".") {
-//                    lastSymbolType=LastSymbolType::ObjectMemberOperator;
-//                } else if (token=="->") {
-//                    lastSymbolType = LastSymbolType::PointerMemberOperator;
-//                } else if (token == ".*") {
-//                    lastSymbolType = LastSymbolType::PointerToMemberOfObjectOperator;
-//                } else if (token == "->*"){
-//                    lastSymbolType = LastSymbolType::PointerToMemberOfPointerOperator;
-//                } else if (token==">") {
-//                    lastSymbolType=LastSymbolType::MatchingAngleQuotation;
-//                    symbolMatchingLevel=0;
-//                } else
-                if (token == ")" ) {
-                    lastSymbolType=LastSymbolType::MatchingParenthesis;
-                    symbolMatchingLevel = 0;
-                } else if (token == "]") {
-                    lastSymbolType=LastSymbolType::MatchingBracket;
-                    symbolMatchingLevel = 0;
-                } else if (token == "*") {
-                    lastSymbolType=LastSymbolType::AsteriskSign;
-                } else if (token == "&") {
-                    lastSymbolType=LastSymbolType::AmpersandSign;
-                } else if (isIdentChar(token.front())) {
-                    lastSymbolType=LastSymbolType::Identifier;
-                } else
-                    return result;
-                break;
-            case LastSymbolType::BracketMatched: //before '[]'
-                if (token == ")" ) {
-                    lastSymbolType=LastSymbolType::MatchingParenthesis;
-                    symbolMatchingLevel = 0;
-                } else if (token == "]") {
-                    lastSymbolType=LastSymbolType::MatchingBracket;
-                    symbolMatchingLevel = 0;
-                } else if (isIdentChar(token.front())) {
-                    lastSymbolType=LastSymbolType::Identifier;
-                } else
-                    return result;
-                break;
-            case LastSymbolType::AngleQuotationMatched: //before '<>'
-                if (isIdentChar(token.front())) {
-                    lastSymbolType=LastSymbolType::Identifier;
-                } else
-                    return result;
-                break;
-            case LastSymbolType::None:
-                if (token =="::") {
-                    lastSymbolType=LastSymbolType::ScopeResolutionOperator;
-                } else if (token == ".") {
-                    lastSymbolType=LastSymbolType::ObjectMemberOperator;
-                } else if (token=="->") {
-                    lastSymbolType = LastSymbolType::PointerMemberOperator;
-                } else if (token == ".*") {
-                    lastSymbolType = LastSymbolType::PointerToMemberOfObjectOperator;
-                } else if (token == "->*"){
-                    lastSymbolType = LastSymbolType::PointerToMemberOfPointerOperator;
-                } else if (token == ")" ) {
-                    lastSymbolType=LastSymbolType::MatchingParenthesis;
-                    symbolMatchingLevel = 0;
-                } else if (token == "]") {
-                    lastSymbolType=LastSymbolType::MatchingBracket;
-                    symbolMatchingLevel = 0;
-                } else if (isIdentChar(token.front())) {
-                    lastSymbolType=LastSymbolType::Identifier;
-                } else
-                    return result;
-                break;
-            case LastSymbolType::TildeSign:
-                if (token =="::") {
-                    lastSymbolType=LastSymbolType::ScopeResolutionOperator;
-                } else {
-                    // "~" must appear after "::"
-                    result.pop_front();
-                    return result;
-                }
-                break;;
-            case LastSymbolType::Identifier:
-                if (token =="::") {
-                    lastSymbolType=LastSymbolType::ScopeResolutionOperator;
-                } else if (token == ".") {
-                    lastSymbolType=LastSymbolType::ObjectMemberOperator;
-                } else if (token=="->") {
-                    lastSymbolType = LastSymbolType::PointerMemberOperator;
-                } else if (token == ".*") {
-                    lastSymbolType = LastSymbolType::PointerToMemberOfObjectOperator;
-                } else if (token == "->*"){
-                    lastSymbolType = LastSymbolType::PointerToMemberOfPointerOperator;
-                } else if (token == "~") {
-                    lastSymbolType=LastSymbolType::TildeSign;
-                } else if (token == "*") {
-                    lastSymbolType=LastSymbolType::AsteriskSign;
-                } else if (token == "&") {
-                    lastSymbolType=LastSymbolType::AmpersandSign;
-                } else
-                    return result; // stop matching;
-                break;
-            case LastSymbolType::MatchingParenthesis:
-                if (token=="(") {
-                    if (symbolMatchingLevel==0) {
-                        lastSymbolType=LastSymbolType::ParenthesisMatched;
-                    } else {
-                        symbolMatchingLevel--;
-                    }
-                } else if (token==")") {
-                    symbolMatchingLevel++;
-                }
-                break;
-            case LastSymbolType::MatchingBracket:
-                if (token=="[") {
-                    if (symbolMatchingLevel==0) {
-                        lastSymbolType=LastSymbolType::BracketMatched;
-                    } else {
-                        symbolMatchingLevel--;
-                    }
-                } else if (token=="]") {
-                    symbolMatchingLevel++;
-                }
-                break;
-            case LastSymbolType::MatchingAngleQuotation:
-                if (token=="<") {
-                    if (symbolMatchingLevel==0) {
-                        lastSymbolType=LastSymbolType::MatchingAngleQuotation;
-                    } else {
-                        symbolMatchingLevel--;
-                    }
-                } else if (token==">") {
-                    symbolMatchingLevel++;
-                }
-                break;
-            }
-            result.push_front(token);
         }
 
         line--;
@@ -2377,11 +2302,15 @@ Editor::QuoteStatus Editor::getQuoteStatus()
 
 void Editor::reparse()
 {
+    if (lines()->mapped())
+        return;
     parseFile(mParser,mFilename,mInProject);
 }
 
 void Editor::reparseTodo()
 {
+    if (lines()->mapped())
+        return;
     pMainWindow->todoParser()->parseFile(mFilename);
 }
 
@@ -4204,6 +4133,8 @@ void Editor::applyColorScheme(const QString& schemeName)
         mCurrentHighlighWordForeground = selectedForeground();
         mCurrentHighlighWordBackground = selectedBackground();
     }
+    setMatchForeground(mCurrentHighlighWordForeground);
+    setMatchBackground(mCurrentHighlighWordBackground);
 
     this->invalidate();
 }
@@ -57,25 +57,6 @@ class Editor : public SynEdit
 {
     Q_OBJECT
 public:
-    enum class LastSymbolType {
-        Identifier,
-        ScopeResolutionOperator, //'::'
-        ObjectMemberOperator, //'.'
-        PointerMemberOperator, //'->'
-        PointerToMemberOfObjectOperator, //'.*'
-        PointerToMemberOfPointerOperator, //'->*'
-        MatchingBracket,
-        BracketMatched,
-        MatchingParenthesis,
-        ParenthesisMatched,
-        TildeSign,    // '~'
-        AsteriskSign, // '*'
-        AmpersandSign, // '&'
-        MatchingAngleQuotation,
-        AngleQuotationMatched,
-        None
-    };
-
     enum MarginNumber {
         LineNumberMargin = 0,
         MarkerMargin = 1,
@@ -228,8 +209,17 @@ private slots:
     void onTipEvalValueReady(const QString& value);
     void onLinesDeleted(int first,int count);
     void onLinesInserted(int first,int count);
+    void onResolveStatementKinds();
 
 private:
+    //kinds of the identifiers in a line, found by the parser with the given serial id
+    struct LineStatementKinds {
+        QString text;
+        QString parserSerialId;
+        QHash<int,StatementKind> kinds; // keyed by the identifier's start char (1-based)
+    };
+    using PLineStatementKinds = std::shared_ptr<LineStatementKinds>;
+
     bool isBraceChar(QChar ch);
     void resetBookmarks();
     QChar getCurrentChar();
@@ -278,6 +268,8 @@ private:
     void popUserCodeInTabStops();
     void onExportedFormatToken(PSynHighlighter syntaxHighlighter, int Line, int column, const QString& token,
         PSynHighlighterAttribute &attr);
+    void resolveStatementKinds(int line);
+    void scheduleResolveStatementKinds();
 private:
     QByteArray mEncodingOption; // the encoding type set by the user
     QByteArray mFileEncoding; // the real encoding of the file (auto detected)
@@ -325,6 +317,8 @@ private:
     BufferCoord mHighlightCharPos1;
     BufferCoord mHighlightCharPos2;
     std::shared_ptr<QHash<StatementKind, std::shared_ptr<ColorSchemeItem> > > mStatementColors;
+    QHash<int,PLineStatementKinds> mStatementKinds; // keyed by line (1-based)
+    QTimer* mStatementKindsTimer;
 
     // QWidget interface
 protected:
@@ -0,0 +1,1036 @@
+/*
+ * Copyright (C) 2020-2022 Roy Qu (royqh1979@gmail.com)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "filesearcher.h"
+#include "mainwindow.h"
+#include "editorlist.h"
+#include "editor.h"
+#include "platform.h"
+#include "project.h"
+#include "settings.h"
+#include "utils.h"
+#include "qsynedit/Search.h"
+#include "qsynedit/SearchRegex.h"
+#include <QDataStream>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QMessageBox>
+#include <QSaveFile>
+#include <QTextCodec>
+#include <algorithm>
+#include <climits>
+
+#define TRIGRAM_INDEX_MAGIC 0x52505449 // "RPTI"
+#define TRIGRAM_INDEX_VERSION 2
+
+// text between two positions, with the lines joined by '\n' like the searched text
+static QString textBetween(const QStringList& lines, const BufferCoord& from, const BufferCoord& to)
+{
+    if (from.Line == to.Line)
+        return lines[from.Line-1].mid(from.Char-1, to.Char-from.Char);
+    QString text = lines[from.Line-1].mid(from.Char-1);
+    for (int line=from.Line+1;line<to.Line;line++) {
+        text.append('\n');
+        text.append(lines[line-1]);
+    }
+    text.append('\n');
+    text.append(lines[to.Line-1].left(to.Char-1));
+    return text;
+}
+
+FileSearchThread::FileSearchThread(PFileSearchTask task, QObject *parent):
+    QThread(parent),
+    mTask(task)
+{
+
+}
+
+void FileSearchThread::run()
+{
+    // search engines keep their results, so each thread has its own one
+    PSynSearchBase searchEngine = FileSearcher::createSearchEngine(mTask->keyword, mTask->options);
+    PSearchResultTreeItemList items = std::make_shared<SearchResultTreeItemList>();
+    QElapsedTimer timer;
+    timer.start();
+    while (!mTask->stop) {
+        QString filename;
+        {
+            QMutexLocker locker(&mTask->mutex);
+            if (mTask->nextFile>=mTask->files.count())
+                break;
+            filename = mTask->files[mTask->nextFile];
+            mTask->nextFile++;
+        }
+        QStringList contents;
+        if (mTask->openedContents.contains(filename)) {
+            contents = mTask->openedContents.value(filename);
+        } else if (!readTextFileToLines(filename,
+                                        mTask->encodings.value(filename,ENCODING_AUTO_DETECT),
+                                        contents)) {
+            mTask->searchedFiles++;
+            continue;
+        }
+        PSearchResultTreeItem item = FileSearcher::findInFile(
+                    filename,
+                    contents,
+                    searchEngine);
+        mTask->searchedFiles++;
+        if (!item->results.isEmpty())
+            items->append(item);
+        // send results in batches, so the result view won't be reset too often
+        if (!items->isEmpty() && timer.elapsed()>=100) {
+            emit resultsFound(items);
+            items = std::make_shared<SearchResultTreeItemList>();
+            timer.restart();
+        }
+    }
+    if (!items->isEmpty())
+        emit resultsFound(items);
+}
+
+FileReplaceThread::FileReplaceThread(PFileReplaceTask task, QObject *parent):
+    QThread(parent),
+    mTask(task)
+{
+
+}
+
+void FileReplaceThread::run()
+{
+    PSynSearchBase searchEngine = FileSearcher::createSearchEngine(mTask->keyword, mTask->options);
+    // only one file is in memory at a time
+    while (!mTask->stop) {
+        PSearchResultTreeItem fileItem;
+        {
+            QMutexLocker locker(&mTask->mutex);
+            if (mTask->nextFile>=mTask->files.count())
+                break;
+            fileItem = mTask->files[mTask->nextFile];
+            mTask->nextFile++;
+        }
+        auto action = finally([this]{
+            mTask->processedFiles++;
+        });
+        QSet<QPair<int,int>> selected;
+        foreach (const PSearchResultTreeItem& item, fileItem->results) {
+            if (item->selected)
+                selected.insert(QPair<int,int>(item->line,item->start));
+        }
+        if (selected.isEmpty())
+            continue;
+        QString text;
+        QByteArray encoding = mTask->encodings.value(fileItem->filename,ENCODING_AUTO_DETECT);
+        QByteArray realEncoding;
+        int invalidChars;
+        // bytes that can't be decoded would be destroyed by writing the text back
+        if (!readTextFile(fileItem->filename,encoding,text,realEncoding,invalidChars)
+                || invalidChars>0) {
+            QMutexLocker locker(&mTask->mutex);
+            mTask->failedFiles.append(fileItem->filename);
+            continue;
+        }
+        int lineEnd = text.indexOf('\n');
+        QString lineBreak = (lineEnd>0 && text[lineEnd-1]=='\r')?"\r\n":"\n";
+        // the positions of the results are in the lines the search has seen
+        QStringList lines;
+        QVector<int> lineStarts;
+        splitTextToLines(text,lines,&lineStarts);
+        QVector<SynSearchMatch> matches = searchEngine->findAllInLines(lines);
+        QString newText;
+        newText.reserve(text.length());
+        int pos = 0;
+        int count = 0;
+        foreach (const SynSearchMatch& match, matches) {
+            if (!selected.remove(QPair<int,int>(match.start.Line,match.start.Char)))
+                continue;
+            int start = lineStarts[match.start.Line-1] + match.start.Char-1;
+            int end = lineStarts[match.end.Line-1] + match.end.Char-1;
+            if (start<pos)
+                continue;
+            QString replacement = searchEngine->replace(
+                        textBetween(lines,match.start,match.end),
+                        mTask->replacement);
+            if (lineBreak != "\n") {
+                replacement.replace("\r\n","\n");
+                replacement.replace("\n",lineBreak);
+            }
+            newText.append(text.midRef(pos,start-pos));
+            newText.append(replacement);
+            pos = end;
+            count++;
+        }
+        // some results are not found, the file is changed since last search
+        if (!selected.isEmpty()) {
+            QMutexLocker locker(&mTask->mutex);
+            mTask->failedFiles.append(fileItem->filename);
+            continue;
+        }
+        if (count == 0)
+            continue;
+        newText.append(text.midRef(pos));
+        text.clear();
+        // non-ascii text makes an auto detected ascii file be saved like the editor saves it
+        if (realEncoding == ENCODING_ASCII && !isTextAllAscii(newText)
+                && encoding == ENCODING_AUTO_DETECT)
+            realEncoding = mTask->defaultEncoding;
+        QByteArray data;
+        int unconvertedChars = 0;
+        if (realEncoding == ENCODING_ASCII) {
+            if (!isTextAllAscii(newText))
+                unconvertedChars = 1;
+            data = newText.toLatin1();
+        } else {
+            if (realEncoding == ENCODING_UTF8_BOM)
+                data = "\xEF\xBB\xBF";
+            QTextCodec* codec = QTextCodec::codecForName(
+                        realEncoding == ENCODING_UTF8_BOM ? ENCODING_UTF8 : realEncoding);
+            QTextCodec::ConverterState state(QTextCodec::IgnoreHeader);
+            if (codec) {
+                data.append(codec->fromUnicode(newText.constData(),newText.length(),&state));
+                unconvertedChars = state.invalidChars;
+            } else {
+                unconvertedChars = 1;
+            }
+        }
+        newText.clear();
+        // the replacement can't be represented in the file's encoding
+        if (unconvertedChars>0) {
+            QMutexLocker locker(&mTask->mutex);
+            mTask->failedFiles.append(fileItem->filename);
+            continue;
+        }
+        // write to a temporary file, and rename it to the file when all is written
+        QSaveFile file(fileItem->filename);
+        bool saved = file.open(QFile::WriteOnly)
+                && file.write(data)==data.length()
+                && file.commit();
+        QMutexLocker locker(&mTask->mutex);
+        if (saved) {
+            mTask->replacedFiles++;
+            mTask->replacedCount+=count;
+        } else {
+            mTask->failedFiles.append(fileItem->filename);
+        }
+    }
+}
+
+TrigramIndexThread::TrigramIndexThread(FileTrigramIndex *index, QObject *parent):
+    QThread(parent),
+    mIndex(index)
+{
+
+}
+
+void TrigramIndexThread::run()
+{
+    mIndex->indexPendingFiles();
+}
+
+FileTrigramIndex::FileTrigramIndex(QObject *parent) : QObject(parent),
+    mNextId(0),
+    mDeadIds(0),
+    mThread(nullptr),
+    mStop(false)
+{
+
+}
+
+FileTrigramIndex::~FileTrigramIndex()
+{
+    clear();
+}
+
+void FileTrigramIndex::indexFiles(const QStringList &files)
+{
+    {
+        QMutexLocker locker(&mMutex);
+        foreach (const QString& filename, files) {
+            if (mPendingFileSet.contains(filename))
+                continue;
+            mPendingFiles.append(filename);
+            mPendingFileSet.insert(filename);
+        }
+        if (mPendingFiles.isEmpty())
+            return;
+    }
+    startIndexThread();
+}
+
+void FileTrigramIndex::setFileEncodings(const QHash<QString, QByteArray> &encodings)
+{
+    {
+        QMutexLocker locker(&mMutex);
+        mEncodings = encodings;
+        for (auto it=mFiles.constBegin();it!=mFiles.constEnd();++it) {
+            if (it->encoding == mEncodings.value(it.key(),ENCODING_AUTO_DETECT)
+                    || mPendingFileSet.contains(it.key()))
+                continue;
+            mPendingFiles.append(it.key());
+            mPendingFileSet.insert(it.key());
+        }
+        if (mPendingFiles.isEmpty())
+            return;
+    }
+    startIndexThread();
+}
+
+void FileTrigramIndex::clear()
+{
+    mStop = true;
+    if (mThread) {
+        mThread->wait();
+        disconnect(mThread, nullptr, this, nullptr);
+        mThread->deleteLater();
+        mThread = nullptr;
+    }
+    mStop = false;
+    QMutexLocker locker(&mMutex);
+    mFiles.clear();
+    mPostings.clear();
+    mPendingFiles.clear();
+    mPendingFileSet.clear();
+    mNextId = 0;
+    mDeadIds = 0;
+}
+
+bool FileTrigramIndex::load(const QString &indexFilename)
+{
+    QFile file(indexFilename);
+    if (!file.open(QFile::ReadOnly))
+        return false;
+    QDataStream in(&file);
+    quint32 magic;
+    qint32 version;
+    in >> magic >> version;
+    if (magic != TRIGRAM_INDEX_MAGIC || version != TRIGRAM_INDEX_VERSION)
+        return false;
+    QHash<QString,IndexedFile> files;
+    QHash<quint64,QVector<int>> postings;
+    qint32 fileCount;
+    qint32 nextId;
+    in >> fileCount;
+    for (int i=0;i<fileCount;i++) {
+        QString filename;
+        IndexedFile indexedFile;
+        in >> filename >> indexedFile.id >> indexedFile.modified >> indexedFile.size >> indexedFile.encoding;
+        files.insert(filename,indexedFile);
+    }
+    in >> nextId >> postings;
+    if (in.status()!=QDataStream::Ok)
+        return false;
+    QMutexLocker locker(&mMutex);
+    mFiles = files;
+    mPostings = postings;
+    mNextId = nextId;
+    mDeadIds = 0;
+    return true;
+}
+
+bool FileTrigramIndex::save(const QString &indexFilename)
+{
+    QDir().mkpath(QFileInfo(indexFilename).absolutePath());
+    QSaveFile file(indexFilename);
+    if (!file.open(QFile::WriteOnly))
+        return false;
+    QDataStream out(&file);
+    QMutexLocker locker(&mMutex);
+    if (mDeadIds>0)
+        removeDeadIds();
+    out << (quint32)TRIGRAM_INDEX_MAGIC << (qint32)TRIGRAM_INDEX_VERSION;
+    out << (qint32)mFiles.count();
+    for (auto it=mFiles.constBegin();it!=mFiles.constEnd();++it) {
+        out << it.key() << it->id << it->modified << it->size << it->encoding;
+    }
+    out << (qint32)mNextId << mPostings;
+    return file.commit();
+}
+
+bool FileTrigramIndex::contains(const QString &filename)
+{
+    QMutexLocker locker(&mMutex);
+    return mFiles.contains(filename) || mPendingFileSet.contains(filename);
+}
+
+QStringList FileTrigramIndex::filterFiles(const QStringList &files, const QString &keyword, SynSearchOptions options)
+{
+    QVector<quint64> required = requiredTrigrams(keyword, options);
+    if (required.isEmpty())
+        return files;
+    // files changed after indexed must be searched
+    QVector<QFileInfo> fileInfos;
+    fileInfos.reserve(files.count());
+    foreach (const QString& filename, files)
+        fileInfos.append(QFileInfo(filename));
+    QStringList result;
+    QStringList staleFiles;
+    {
+        QMutexLocker locker(&mMutex);
+        // intersect the postings of the required trigrams, from the shortest one
+        QVector<const QVector<int>*> postings;
+        bool allFound = true;
+        foreach (quint64 trigram, required) {
+            auto it = mPostings.constFind(trigram);
+            if (it == mPostings.constEnd()) {
+                allFound = false;
+                break;
+            }
+            postings.append(&it.value());
+        }
+        QVector<int> ids;
+        if (allFound) {
+            std::sort(postings.begin(),postings.end(),
+                      [](const QVector<int>* p1, const QVector<int>* p2){
+                return p1->count() < p2->count();
+            });
+            ids = *postings[0];
+            for (int i=1;i<postings.count() && !ids.isEmpty();i++) {
+                QVector<int> intersection;
+                std::set_intersection(ids.begin(),ids.end(),
+                                      postings[i]->begin(),postings[i]->end(),
+                                      std::back_inserter(intersection));
+                ids.swap(intersection);
+            }
+        }
+        for (int i=0;i<files.count();i++) {
+            const QString& filename = files[i];
+            if (mPendingFileSet.contains(filename)) {
+                result.append(filename);
+                continue;
+            }
+            auto it = mFiles.constFind(filename);
+            if (it == mFiles.constEnd()
+                    || it->modified != fileInfos[i].lastModified()
+                    || it->size != fileInfos[i].size()
+                    || it->encoding != mEncodings.value(filename,ENCODING_AUTO_DETECT)) {
+                result.append(filename);
+                staleFiles.append(filename);
+                continue;
+            }
+            if (std::binary_search(ids.begin(),ids.end(),it->id))
+                result.append(filename);
+        }
+    }
+    if (!staleFiles.isEmpty())
+        indexFiles(staleFiles);
+    return result;
+}
+
+int FileTrigramIndex::fileCount()
+{
+    QMutexLocker locker(&mMutex);
+    return mFiles.count();
+}
+
+int FileTrigramIndex::trigramCount()
+{
+    QMutexLocker locker(&mMutex);
+    return mPostings.count();
+}
+
+qint64 FileTrigramIndex::memoryUsage()
+{
+    QMutexLocker locker(&mMutex);
+    qint64 size = 0;
+    for (auto it=mPostings.constBegin();it!=mPostings.constEnd();++it) {
+        size += sizeof(quint64) + sizeof(QVector<int>) + it->capacity() * sizeof(int);
+    }
+    for (auto it=mFiles.constBegin();it!=mFiles.constEnd();++it) {
+        size += it.key().length() * sizeof(QChar) + sizeof(IndexedFile);
+    }
+    return size;
+}
+
+QVector<quint64> FileTrigramIndex::extractTrigrams(const QStringList &lines)
+{
+    QVector<quint64> trigrams;
+    foreach (const QString& line, lines) {
+        if (line.length()<3)
+            continue;
+        const QChar* p = line.constData();
+        quint64 c0 = p[0].toLower().unicode();
+        quint64 c1 = p[1].toLower().unicode();
+        for (int i=2;i<line.length();i++) {
+            quint64 c2 = p[i].toLower().unicode();
+            trigrams.append((c0 << 32) | (c1 << 16) | c2);
+            c0 = c1;
+            c1 = c2;
+        }
+    }
+    std::sort(trigrams.begin(),trigrams.end());
+    trigrams.erase(std::unique(trigrams.begin(),trigrams.end()),trigrams.end());
+    return trigrams;
+}
+
+QVector<quint64> FileTrigramIndex::requiredTrigrams(const QString &keyword, SynSearchOptions options)
+{
+    // literal texts that must be in the matched text
+    QStringList literals;
+    if (!options.testFlag(ssoRegExp)) {
+        literals = keyword.split('\n');
+    } else if (!keyword.contains('|')) {
+        // only use the literals out of groups; chars followed by ?,* or {} are optional
+        QString literal;
+        int groupLevel = 0;
+        int i=0;
+        while (i<keyword.length()) {
+            QChar ch = keyword[i];
+            QChar lit;
+            if (ch == '\\') {
+                if (i+1>=keyword.length())
+                    break;
+                QChar next = keyword[i+1];
+                if (!next.isLetterOrNumber()) {
+                    lit = next;
+                } else if (!QString("dDwWsShHvVRXbBAzZGKntrfae").contains(next)) {
+                    // escapes whose length is unknown (\x41, \012, \Qfoo\E, back references...),
+                    // the chars after them can't be read as literals
+                    literals.append(literal);
+                    literal.clear();
+                    break;
+                }
+                // char classes, anchors and escaped control chars end the literal
+                i+=2;
+            } else if (ch == '[') {
+                i++;
+                if (i<keyword.length() && keyword[i]=='^')
+                    i++;
+                if (i<keyword.length() && keyword[i]==']')
+                    i++;
+                while (i<keyword.length() && keyword[i]!=']') {
+                    if (keyword[i]=='\\')
+                        i++;
+                    i++;
+                }
+                i++;
+            } else if (ch == '(') {
+                groupLevel++;
+                i++;
+            } else if (ch == ')') {
+                groupLevel--;
+                i++;
+            } else if (ch == '{') {
+                while (i<keyword.length() && keyword[i]!='}')
+                    i++;
+                i++;
+            } else if (ch == '.' || ch == '^' || ch == '$'
+                       || ch == '*' || ch == '+' || ch == '?') {
+                i++;
+            } else {
+                lit = ch;
+                i++;
+            }
+            if (lit.isNull() || groupLevel>0) {
+                literals.append(literal);
+                literal.clear();
+                continue;
+            }
+            QChar quantifier = (i<keyword.length())?keyword[i]:QChar();
+            if (quantifier == '*' || quantifier == '?' || quantifier == '{') {
+                literals.append(literal);
+                literal.clear();
+            } else if (quantifier == '+') {
+                literal.append(lit);
+                literals.append(literal);
+                literal.clear();
+            } else {
+                literal.append(lit);
+            }
+        }
+        literals.append(literal);
+    }
+    QVector<quint64> trigrams = extractTrigrams(literals);
+    return trigrams;
+}
+
+void FileTrigramIndex::onIndexThreadFinished()
+{
+    if (mThread) {
+        mThread->deleteLater();
+        mThread = nullptr;
+    }
+    bool hasPendingFiles;
+    {
+        QMutexLocker locker(&mMutex);
+        hasPendingFiles = !mPendingFiles.isEmpty();
+    }
+    // files added after the thread had finished its work
+    if (hasPendingFiles && !mStop)
+        startIndexThread();
+}
+
+void FileTrigramIndex::indexPendingFiles()
+{
+    QElapsedTimer timer;
+    timer.start();
+    int indexedFiles = 0;
+    while (!mStop) {
+        QString filename;
+        QByteArray encoding;
+        IndexedFile oldFile{-1,QDateTime(),-1,QByteArray()};
+        {
+            QMutexLocker locker(&mMutex);
+            if (mPendingFiles.isEmpty())
+                break;
+            // it's kept in the pending set until indexed, so it won't be filtered by the old trigrams
+            filename = mPendingFiles.takeFirst();
+            oldFile = mFiles.value(filename,oldFile);
+            encoding = mEncodings.value(filename,ENCODING_AUTO_DETECT);
+        }
+        QFileInfo info(filename);
+        bool changed = (oldFile.id<0
+                        || oldFile.modified != info.lastModified()
+                        || oldFile.size != info.size()
+                        || oldFile.encoding != encoding);
+        QVector<quint64> trigrams;
+        bool loaded = false;
+        if (changed) {
+            QStringList contents;
+            loaded = info.exists() && readTextFileToLines(filename,encoding,contents);
+            if (loaded)
+                trigrams = extractTrigrams(contents);
+        }
+        QMutexLocker locker(&mMutex);
+        mPendingFileSet.remove(filename);
+        if (!changed)
+            continue;
+        if (mFiles.remove(filename)>0)
+            mDeadIds++;
+        // files that can't be read are not indexed, so they are always searched
+        if (!loaded)
+            continue;
+        IndexedFile indexedFile{mNextId++,info.lastModified(),info.size(),encoding};
+        mFiles.insert(filename,indexedFile);
+        foreach (quint64 trigram, trigrams)
+            mPostings[trigram].append(indexedFile.id);
+        indexedFiles++;
+    }
+    {
+        QMutexLocker locker(&mMutex);
+        if (mDeadIds > mFiles.count())
+            removeDeadIds();
+    }
+    if (indexedFiles>0)
+        emit indexUpdated(indexedFiles,timer.elapsed());
+}
+
+void FileTrigramIndex::removeDeadIds()
+{
+    QSet<int> liveIds;
+    foreach (const IndexedFile& indexedFile, mFiles)
+        liveIds.insert(indexedFile.id);
+    for (auto it=mPostings.begin();it!=mPostings.end();) {
+        QVector<int>& ids = it.value();
+        ids.erase(std::remove_if(ids.begin(),ids.end(),[&liveIds](int id){
+                      return !liveIds.contains(id);
+                  }),ids.end());
+        if (ids.isEmpty()) {
+            it = mPostings.erase(it);
+        } else {
+            ids.squeeze();
+            ++it;
+        }
+    }
+    mDeadIds = 0;
+}
+
+void FileTrigramIndex::startIndexThread()
+{
+    // the running thread will take the new pending files
+    if (mThread)
+        return;
+    mThread = new TrigramIndexThread(this,this);
+    connect(mThread, &QThread::finished,
+            this, &FileTrigramIndex::onIndexThreadFinished);
+    mThread->start();
+}
+
+FileSearcher::FileSearcher(QObject *parent) : QObject(parent),
+    mRunningReplaceThreads(0),
+    mIndex(nullptr),
+    mRunningThreads(0)
+{
+    mProgressTimer = new QTimer(this);
+    mProgressTimer->setInterval(200);
+    connect(mProgressTimer, &QTimer::timeout,
+            this, &FileSearcher::onProgressTimeout);
+}
+
+FileSearcher::~FileSearcher()
+{
+    cancelSearch();
+    cancelReplace();
+    closeIndex();
+}
+
+void FileSearcher::findInFiles(const QString &keyword, SynSearchOptions options,
+                               SearchFileScope scope, const QStringList &files)
+{
+    cancelSearch();
+    mResults = pMainWindow->searchResultModel()->addSearchResults(
+                keyword,
+                options,
+                scope);
+    mTask = std::make_shared<FileSearchTask>();
+    mTask->keyword = keyword;
+    mTask->options = options;
+    mTask->nextFile = 0;
+    mTask->searchedFiles = 0;
+    mTask->stop = false;
+    mTask->encodings = projectFileEncodings();
+    QSet<QString> addedFiles;
+    foreach (const QString& filename, files) {
+        if (addedFiles.contains(filename))
+            continue;
+        addedFiles.insert(filename);
+        mTask->files.append(filename);
+        // editors can only be accessed in the gui thread
+        QStringList buffer;
+        if (pMainWindow->editorList()->getContentFromOpenedEditor(filename,buffer))
+            mTask->openedContents.insert(filename,buffer);
+    }
+    mIndexMessage.clear();
+    if (mIndex && scope == SearchFileScope::wholeProject) {
+        QElapsedTimer timer;
+        timer.start();
+        // the index is built from the files on disk, so opened files are always searched
+        QStringList filesOnDisk;
+        foreach (const QString& filename, mTask->files) {
+            if (!mTask->openedContents.contains(filename))
+                filesOnDisk.append(filename);
+        }
+        mIndex->setFileEncodings(mTask->encodings);
+        QSet<QString> candidates;
+        foreach (const QString& filename, mIndex->filterFiles(filesOnDisk,keyword,options))
+            candidates.insert(filename);
+        QStringList searchFiles;
+        foreach (const QString& filename, mTask->files) {
+            if (mTask->openedContents.contains(filename) || candidates.contains(filename))
+                searchFiles.append(filename);
+        }
+        mIndexMessage = tr("%1 files skipped by the index in %2 ms")
+                .arg(mTask->files.count()-searchFiles.count())
+                .arg(timer.elapsed());
+        mTask->files = searchFiles;
+    }
+    pMainWindow->searchResultModel()->notifySearchResultsUpdated();
+    mRunningThreads = std::max(1,std::min(QThread::idealThreadCount(),mTask->files.count()));
+    for (int i=0;i<mRunningThreads;i++) {
+        FileSearchThread* thread = new FileSearchThread(mTask,this);
+        connect(thread, &FileSearchThread::resultsFound,
+                this, &FileSearcher::onResultsFound);
+        connect(thread, &QThread::finished,
+                this, &FileSearcher::onSearchThreadFinished);
+        thread->start();
+    }
+    mProgressTimer->start();
+    emit searchStarted();
+}
+
+bool FileSearcher::searching() const
+{
+    return mTask!=nullptr;
+}
+
+void FileSearcher::replaceInFiles(PSearchResults results, const QString &replacement)
+{
+    cancelSearch();
+    cancelReplace();
+    mReplaceTask = std::make_shared<FileReplaceTask>();
+    mReplaceTask->keyword = results->keyword;
+    mReplaceTask->options = results->options;
+    if (results->searchType == SearchType::FindOccurences)
+        mReplaceTask->options = ssoMatchCase | ssoWholeWord;
+    mReplaceTask->replacement = replacement;
+    mReplaceTask->nextFile = 0;
+    mReplaceTask->replacedFiles = 0;
+    mReplaceTask->replacedCount = 0;
+    mReplaceTask->processedFiles = 0;
+    mReplaceTask->stop = false;
+    mReplaceTask->encodings = projectFileEncodings();
+    mReplaceTask->defaultEncoding = pSettings->editor().useUTF8ByDefault()?
+                ENCODING_UTF8 : QTextCodec::codecForLocale()->name();
+    PSynSearchBase searchEngine = createSearchEngine(mReplaceTask->keyword, mReplaceTask->options);
+    foreach (const PSearchResultTreeItem& fileItem, results->results) {
+        // editors can only be accessed in the gui thread
+        Editor* e = pMainWindow->editorList()->getOpenedEditorByFilename(fileItem->filename);
+        if (!e) {
+            mReplaceTask->files.append(fileItem);
+            continue;
+        }
+        QSet<QPair<int,int>> selected;
+        foreach (const PSearchResultTreeItem& item, fileItem->results) {
+            if (item->selected)
+                selected.insert(QPair<int,int>(item->line,item->start));
+        }
+        if (selected.isEmpty())
+            continue;
+        QVector<SynSearchMatch> matches;
+        foreach (const SynSearchMatch& match, e->findAllMatches(searchEngine,1,e->lines()->count())) {
+            if (selected.remove(QPair<int,int>(match.start.Line,match.start.Char)))
+                matches.append(match);
+        }
+        if (!selected.isEmpty() || e->readOnly()) {
+            mReplaceTask->failedFiles.append(fileItem->filename);
+            continue;
+        }
+        e->replaceMatches(matches,searchEngine,replacement);
+        mReplaceTask->replacedFiles++;
+        mReplaceTask->replacedCount+=matches.count();
+    }
+    mRunningReplaceThreads = std::max(1,std::min(QThread::idealThreadCount(),mReplaceTask->files.count()));
+    for (int i=0;i<mRunningReplaceThreads;i++) {
+        FileReplaceThread* thread = new FileReplaceThread(mReplaceTask,this);
+        connect(thread, &QThread::finished,
+                this, &FileSearcher::onReplaceThreadFinished);
+        thread->start();
+    }
+    mProgressTimer->start();
+    emit searchStarted();
+}
+
+bool FileSearcher::replacing() const
+{
+    return mReplaceTask!=nullptr;
+}
+
+void FileSearcher::openIndex(const QString &indexFilename, const QStringList &files)
+{
+    if (mIndexFilename != indexFilename) {
+        closeIndex();
+        mIndex = new FileTrigramIndex(this);
+        connect(mIndex, &FileTrigramIndex::indexUpdated,
+                this, &FileSearcher::onIndexUpdated);
+        mIndex->load(indexFilename);
+        mIndexFilename = indexFilename;
+    }
+    mIndex->setFileEncodings(projectFileEncodings());
+    mIndex->indexFiles(files);
+}
+
+void FileSearcher::closeIndex()
+{
+    if (!mIndex)
+        return;
+    mIndex->save(mIndexFilename);
+    delete mIndex;
+    mIndex = nullptr;
+    mIndexFilename.clear();
+}
+
+void FileSearcher::updateIndexedFile(const QString &filename)
+{
+    if (mIndex && mIndex->contains(filename))
+        mIndex->indexFiles(QStringList{filename});
+}
+
+void FileSearcher::updateIndexEncodings()
+{
+    if (mIndex)
+        mIndex->setFileEncodings(projectFileEncodings());
+}
+
+PSearchResultTreeItem FileSearcher::findInFile(
+        const QString &filename,
+        const QStringList &contents,
+        PSynSearchBase searchEngine)
+{
+    PSearchResultTreeItem parentItem = std::make_shared<SearchResultTreeItem>();
+    parentItem->filename = filename;
+    parentItem->parent = nullptr;
+    QVector<SynSearchMatch> matches = searchEngine->findAllInLines(contents);
+    foreach (const SynSearchMatch& match, matches) {
+        PSearchResultTreeItem item = std::make_shared<SearchResultTreeItem>();
+        item->filename = filename;
+        item->line = match.start.Line;
+        item->start = match.start.Char;
+        item->len = match.length;
+        item->parent = parentItem.get();
+        item->text = contents[match.start.Line-1];
+        item->text.replace('\t',' ');
+        parentItem->results.append(item);
+    }
+    return parentItem;
+}
+
+PSynSearchBase FileSearcher::createSearchEngine(const QString &keyword, SynSearchOptions options)
+{
+    PSynSearchBase searchEngine;
+    if (options.testFlag(ssoRegExp))
+        searchEngine = std::make_shared<SynSearchRegex>();
+    else
+        searchEngine = std::make_shared<SynSearch>();
+    searchEngine->setOptions(options);
+    searchEngine->setPattern(keyword);
+    return searchEngine;
+}
+
+void FileSearcher::stopSearch()
+{
+    if (!mTask && !mReplaceTask)
+        return;
+    cancelSearch();
+    // files already replaced are kept
+    cancelReplace();
+    emit searchFinished();
+}
+
+void FileSearcher::cancelSearch()
+{
+    if (!mTask)
+        return;
+    mTask->stop = true;
+    foreach (QObject* child, children()) {
+        FileSearchThread* thread = qobject_cast<FileSearchThread*>(child);
+        if (thread) {
+            thread->wait();
+            thread->setParent(nullptr);
+            thread->deleteLater();
+        }
+    }
+    mProgressTimer->stop();
+    mTask.reset();
+    mResults.reset();
+    mRunningThreads = 0;
+}
+
+void FileSearcher::cancelReplace()
+{
+    if (!mReplaceTask)
+        return;
+    mReplaceTask->stop = true;
+    foreach (QObject* child, children()) {
+        FileReplaceThread* thread = qobject_cast<FileReplaceThread*>(child);
+        if (thread) {
+            thread->wait();
+            thread->setParent(nullptr);
+            thread->deleteLater();
+        }
+    }
+    mProgressTimer->stop();
+    mReplaceTask.reset();
+    mRunningReplaceThreads = 0;
+}
+
+QHash<QString,QByteArray> FileSearcher::projectFileEncodings() const
+{
+    QHash<QString,QByteArray> encodings;
+    std::shared_ptr<Project> project = pMainWindow->project();
+    if (!project)
+        return encodings;
+    QDir dir(project->directory());
+    foreach (const PProjectUnit& unit, project->units()) {
+        if (unit->encoding() != ENCODING_AUTO_DETECT)
+            encodings.insert(dir.absoluteFilePath(unit->fileName()),unit->encoding());
+    }
+    return encodings;
+}
+
+void FileSearcher::onResultsFound(PSearchResultTreeItemList items)
+{
+    // results from a stopped search
+    if (!mResults || sender()==nullptr || sender()->parent()!=this)
+        return;
+    mResults->results.append(*items);
+    pMainWindow->searchResultModel()->notifySearchResultsUpdated();
+}
+
+void FileSearcher::onSearchThreadFinished()
+{
+    FileSearchThread* thread = qobject_cast<FileSearchThread*>(sender());
+    if (!thread || thread->parent()!=this)
+        return;
+    thread->setParent(nullptr);
+    thread->deleteLater();
+    mRunningThreads--;
+    if (mRunningThreads>0)
+        return;
+    // keep the same order as the searched files
+    QHash<QString,int> fileOrders;
+    for (int i=0;i<mTask->files.count();i++)
+        fileOrders.insert(mTask->files[i],i);
+    std::sort(mResults->results.begin(),mResults->results.end(),
+              [&fileOrders](const PSearchResultTreeItem& item1, const PSearchResultTreeItem& item2){
+        return fileOrders.value(item1->filename) < fileOrders.value(item2->filename);
+    });
+    int matchCount = 0;
+    foreach (const PSearchResultTreeItem& item, mResults->results)
+        matchCount += item->results.count();
+    QString message = tr("%1 files searched, %2 matches found.")
+            .arg(mTask->files.count()).arg(matchCount);
+    if (!mIndexMessage.isEmpty())
+        message += " (" + mIndexMessage + ")";
+    pMainWindow->updateStatusbarMessage(message);
+    mProgressTimer->stop();
+    mTask.reset();
+    mResults.reset();
+    pMainWindow->searchResultModel()->notifySearchResultsUpdated();
+    emit searchFinished();
+}
+
+void FileSearcher::onReplaceThreadFinished()
+{
+    FileReplaceThread* thread = qobject_cast<FileReplaceThread*>(sender());
+    if (!thread || thread->parent()!=this)
+        return;
+    thread->setParent(nullptr);
+    thread->deleteLater();
+    mRunningReplaceThreads--;
+    if (mRunningReplaceThreads>0)
+        return;
+    mProgressTimer->stop();
+    PFileReplaceTask task = mReplaceTask;
+    mReplaceTask.reset();
+    pMainWindow->updateStatusbarMessage(tr("%1 matches replaced in %2 files.")
+                                        .arg(task->replacedCount).arg(task->replacedFiles));
+    emit searchFinished();
+    if (!task->failedFiles.isEmpty()) {
+        QStringList files = task->failedFiles.mid(0,20);
+        if (task->failedFiles.count()>files.count())
+            files.append("...");
+        QMessageBox::critical(pMainWindow,
+                              tr("Replace Error"),
+                              tr("Can't replace in the following files, their contents may have changed since last search:")
+                              + "<br />" + files.join("<br />"));
+    }
+}
+
+void FileSearcher::onProgressTimeout()
+{
+    if (mReplaceTask) {
+        pMainWindow->updateStatusbarMessage(tr("Replacing... %1/%2 files")
+                                            .arg(mReplaceTask->processedFiles.load())
+                                            .arg(mReplaceTask->files.count()));
+        return;
+    }
+    if (!mTask)
+        return;
+    pMainWindow->updateStatusbarMessage(tr("Searching... %1/%2 files")
+                                        .arg(mTask->searchedFiles.load()).arg(mTask->files.count()));
+}
+
+void FileSearcher::onIndexUpdated(int indexedFiles, qint64 elapsed)
+{
+    // don't hide the search progress
+    if (mTask || !mIndex)
+        return;
+    pMainWindow->updateStatusbarMessage(
+                tr("Search index updated: %1 files indexed in %2 ms, %3 files and %4 trigrams in the index (%5 KB).")
+                .arg(indexedFiles).arg(elapsed)
+                .arg(mIndex->fileCount()).arg(mIndex->trigramCount())
+                .arg(mIndex->memoryUsage()/1024));
+}
@@ -0,0 +1,212 @@
+/*
+ * Copyright (C) 2020-2022 Roy Qu (royqh1979@gmail.com)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef FILESEARCHER_H
+#define FILESEARCHER_H
+
+#include <QObject>
+#include <QMutex>
+#include <QThread>
+#include <QTimer>
+#include <QDateTime>
+#include <QSet>
+#include <atomic>
+#include "widgets/searchresultview.h"
+
+// files to be searched by the file search threads, shared between them
+struct FileSearchTask {
+    QString keyword;
+    SynSearchOptions options;
+    QStringList files;
+    QHash<QString,QStringList> openedContents; // contents of the files opened in editors
+    QHash<QString,QByteArray> encodings; // encodings of the project files, other files are auto detected
+    int nextFile;
+    QMutex mutex;
+    std::atomic<int> searchedFiles;
+    std::atomic<bool> stop;
+};
+using PFileSearchTask = std::shared_ptr<FileSearchTask>;
+
+class FileSearchThread : public QThread
+{
+    Q_OBJECT
+public:
+    explicit FileSearchThread(PFileSearchTask task, QObject *parent = nullptr);
+signals:
+    void resultsFound(PSearchResultTreeItemList items);
+private:
+    PFileSearchTask mTask;
+    // QThread interface
+protected:
+    void run() override;
+};
+
+// files to be replaced by the file replace threads, shared between them
+struct FileReplaceTask {
+    QString keyword;
+    SynSearchOptions options;
+    QString replacement;
+    SearchResultTreeItemList files; // only the selected results are replaced
+    QHash<QString,QByteArray> encodings; // encodings of the project files, other files are auto detected
+    QByteArray defaultEncoding; // used when non-ascii text is written to an ascii file
+    int nextFile;
+    QMutex mutex;
+    QStringList failedFiles;
+    int replacedFiles;
+    int replacedCount;
+    std::atomic<int> processedFiles;
+    std::atomic<bool> stop;
+};
+using PFileReplaceTask = std::shared_ptr<FileReplaceTask>;
+
+class FileReplaceThread : public QThread
+{
+    Q_OBJECT
+public:
+    explicit FileReplaceThread(PFileReplaceTask task, QObject *parent = nullptr);
+private:
+    PFileReplaceTask mTask;
+    // QThread interface
+protected:
+    void run() override;
+};
+
+class FileTrigramIndex;
+
+class TrigramIndexThread : public QThread
+{
+    Q_OBJECT
+public:
+    explicit TrigramIndexThread(FileTrigramIndex* index, QObject *parent = nullptr);
+private:
+    FileTrigramIndex* mIndex;
+    // QThread interface
+protected:
+    void run() override;
+};
+
+// Lowercased trigrams (3 chars in a line) of the files' contents, mapped to the files containing them.
+// A file can only match the keyword if it contains all trigrams of the keyword,
+// so the other files are skipped before searching.
+class FileTrigramIndex : public QObject
+{
+    Q_OBJECT
+public:
+    explicit FileTrigramIndex(QObject *parent = nullptr);
+    ~FileTrigramIndex();
+
+    // index the files in background; files that are not changed since last indexed are skipped
+    void indexFiles(const QStringList& files);
+    // files are indexed with the same encodings as they are searched; files whose encoding is changed are re-indexed
+    void setFileEncodings(const QHash<QString,QByteArray>& encodings);
+    void clear();
+    bool load(const QString& indexFilename);
+    bool save(const QString& indexFilename);
+    bool contains(const QString& filename);
+
+    // files in the list that may contain the keyword. Files that are not indexed yet are always kept
+    QStringList filterFiles(const QStringList& files, const QString& keyword, SynSearchOptions options);
+
+    int fileCount();
+    int trigramCount();
+    qint64 memoryUsage();
+
+    static QVector<quint64> extractTrigrams(const QStringList& lines);
+    // trigrams that any text matching the keyword must contain
+    static QVector<quint64> requiredTrigrams(const QString& keyword, SynSearchOptions options);
+signals:
+    void indexUpdated(int indexedFiles, qint64 elapsed);
+private slots:
+    void onIndexThreadFinished();
+private:
+    void indexPendingFiles();
+    void removeDeadIds();
+    void startIndexThread();
+private:
+    struct IndexedFile {
+        int id;
+        QDateTime modified;
+        qint64 size;
+        QByteArray encoding; // encoding used to decode the file
+    };
+    QMutex mMutex;
+    QHash<QString,IndexedFile> mFiles;
+    QHash<quint64,QVector<int>> mPostings; // sorted ids of the files containing the trigram
+    int mNextId;
+    int mDeadIds; // ids of the re-indexed files, still in the postings
+    QStringList mPendingFiles;
+    QSet<QString> mPendingFileSet;
+    QHash<QString,QByteArray> mEncodings; // encodings of the project files, other files are auto detected
+    TrigramIndexThread* mThread;
+    std::atomic<bool> mStop;
+    friend class TrigramIndexThread;
+};
+
+class FileSearcher : public QObject
+{
+    Q_OBJECT
+public:
+    explicit FileSearcher(QObject *parent = nullptr);
+    ~FileSearcher();
+
+    // search the files in background, the results are added to the search result model as they are found
+    void findInFiles(const QString& keyword, SynSearchOptions options,
+                     SearchFileScope scope, const QStringList& files);
+    bool searching() const;
+    // replace the selected results: opened editors are changed in one undo block,
+    // the other files are changed and saved by the worker threads.
+    void replaceInFiles(PSearchResults results, const QString& replacement);
+    bool replacing() const;
+
+    // index the files in the project to narrow project searches, the index is kept in indexFilename
+    void openIndex(const QString& indexFilename, const QStringList& files);
+    void closeIndex();
+    void updateIndexedFile(const QString& filename);
+    void updateIndexEncodings();
+
+    static PSearchResultTreeItem findInFile(
+            const QString& filename,
+            const QStringList& contents,
+            PSynSearchBase searchEngine);
+    static PSynSearchBase createSearchEngine(const QString& keyword, SynSearchOptions options);
+signals:
+    void searchStarted();
+    void searchFinished();
+public slots:
+    void stopSearch();
+private slots:
+    void onResultsFound(PSearchResultTreeItemList items);
+    void onSearchThreadFinished();
+    void onReplaceThreadFinished();
+    void onProgressTimeout();
+    void onIndexUpdated(int indexedFiles, qint64 elapsed);
+private:
+    void cancelSearch();
+    void cancelReplace();
+    QHash<QString,QByteArray> projectFileEncodings() const;
+private:
+    PFileSearchTask mTask;
+    PFileReplaceTask mReplaceTask;
+    int mRunningReplaceThreads;
+    FileTrigramIndex* mIndex;
+    QString mIndexFilename;
+    QString mIndexMessage; // how the index narrowed the current search
+    PSearchResults mResults;
+    int mRunningThreads;
+    QTimer* mProgressTimer;
+};
+
+#endif // FILESEARCHER_H
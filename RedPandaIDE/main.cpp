@@ -130,6 +130,7 @@ int main(int argc, char *argv[])
     qRegisterMetaType<PCompileIssue>("PCompileIssue&");
     qRegisterMetaType<QVector<int>>("QVector<int>");
     qRegisterMetaType<QHash<int,QString>>("QHash<int,QString>");
+    qRegisterMetaType<PSearchResultTreeItemList>("PSearchResultTreeItemList");
 
     initParser();
 
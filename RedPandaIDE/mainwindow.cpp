@@ -61,9 +61,11 @@
 #include "compiler/compilermanager.h"
 #include <QGuiApplication>
 #include <QClipboard>
+#include <QCryptographicHash>
 #include <QMessageBox>
 #include <QTextCodec>
 #include "cpprefacter.h"
+#include "filesearcher.h"
 
 #include <widgets/searchdialog.h>
 
@@ -86,6 +88,8 @@ MainWindow::MainWindow(QWidget *parent)
     : QMainWindow(parent),
       ui(new Ui::MainWindow),
       mSearchDialog(nullptr),
+      mRefacter(nullptr),
+      mFileSearcher(nullptr),
       mQuitting(false),
       mCheckSyntaxInBack(false),
       mOpenClosingBottomPanel(false),
@@ -243,6 +247,13 @@ MainWindow::MainWindow(QWidget *parent)
     ui->tableTODO->setModel(&mTodoModel);
     connect(mSearchResultTreeModel.get() , &QAbstractItemModel::modelReset,
             ui->searchView,&QTreeView::expandAll);
+    // the refacter and the file searcher share the stop button
+    mRefacter = new CppRefacter(this);
+    connect(mRefacter, &CppRefacter::searchStarted, this, &MainWindow::updateStopSearchButton);
+    connect(mRefacter, &CppRefacter::searchFinished, this, &MainWindow::updateStopSearchButton);
+    mFileSearcher = new FileSearcher(this);
+    connect(mFileSearcher, &FileSearcher::searchStarted, this, &MainWindow::updateStopSearchButton);
+    connect(mFileSearcher, &FileSearcher::searchFinished, this, &MainWindow::updateStopSearchButton);
     ui->replacePanel->setVisible(false);
     ui->tabProblem->setEnabled(false);
     ui->btnRemoveProblem->setEnabled(false);
@@ -1025,6 +1036,7 @@ void MainWindow::openProject(const QString &filename)
         //parse the project
         //  UpdateClassBrowsing;
         scanActiveProject(true);
+        updateSearchIndex();
         mProject->doAutoOpen();
 
         //update editor's inproject flag
@@ -1039,6 +1051,7 @@ void MainWindow::openProject(const QString &filename)
                 unit->setEditor(nullptr);
             }
         }
+        mFileSearcher->updateIndexEncodings();
 
         Editor * e = mEditorList->getEditor();
         if (e) {
@@ -3411,6 +3424,7 @@ void MainWindow::closeProject(bool refreshEditor)
                     mEditorList->endUpdate();
                 });
                 mProject.reset();
+                updateSearchIndex();
 
                 if (!mQuitting && refreshEditor) {
                     //reset Class browsing
@@ -3431,6 +3445,13 @@ void MainWindow::closeProject(bool refreshEditor)
     }
 }
 
+void MainWindow::updateStopSearchButton()
+{
+    ui->btnStopSearch->setEnabled(mRefacter->searching()
+                                  || mFileSearcher->searching()
+                                  || mFileSearcher->replacing());
+}
+
 void MainWindow::updateProjectView()
 {
     if (mProject) {
@@ -3451,6 +3472,7 @@ void MainWindow::updateProjectView()
 
 void MainWindow::onFileChanged(const QString &path)
 {
+    mFileSearcher->updateIndexedFile(path);
     Editor *e = mEditorList->getOpenedEditorByFilename(path);
     if (e) {
         if (fileExists(path)) {
@@ -3505,6 +3527,27 @@ SearchResultModel *MainWindow::searchResultModel()
     return &mSearchResultModel;
 }
 
+FileSearcher *MainWindow::fileSearcher() const
+{
+    return mFileSearcher;
+}
+
+void MainWindow::updateSearchIndex()
+{
+    if (mProject && pSettings->environment().indexFilesForSearch()) {
+        QStringList files;
+        foreach (const PProjectUnit& unit, mProject->units())
+            files.append(unit->fileName());
+        QString indexFilename = includeTrailingPathDelimiter(QFileInfo(pSettings->filename()).path())
+                + DEV_SEARCH_INDEX_DIR + "/"
+                + QCryptographicHash::hash(mProject->filename().toUtf8(),QCryptographicHash::Md5).toHex()
+                + ".idx";
+        mFileSearcher->openIndex(indexFilename, files);
+    } else {
+        mFileSearcher->closeIndex();
+    }
+}
+
 EditorList *MainWindow::editorList() const
 {
     return mEditorList;
@@ -4539,11 +4582,16 @@ void MainWindow::on_btnSearchAgain_clicked()
                                    results->scope,
                                    results->options);
     } else if (results->searchType == SearchType::FindOccurences) {
-        CppRefacter refactor;
-        refactor.findOccurence(results->statementFullname,results->scope);
+        mRefacter->findOccurence(results->statementFullname,results->scope);
     }
 }
 
+void MainWindow::on_btnStopSearch_clicked()
+{
+    mRefacter->stopFindOccurence();
+    mFileSearcher->stopSearch();
+}
+
 void MainWindow::on_actionRemove_Watch_triggered()
 {
     QModelIndex index =ui->watchView->currentIndex();
@@ -4748,8 +4796,7 @@ void MainWindow::on_actionFind_references_triggered()
     Editor * editor = mEditorList->getEditor();
     BufferCoord pos;
     if (editor && editor->pointToCharLine(mEditorContextMenuPos,pos)) {
-        CppRefacter refactor;
-        refactor.findOccurence(editor,pos);
+        mRefacter->findOccurence(editor,pos);
         showSearchPanel(true);
     }
 }
@@ -4957,6 +5004,7 @@ void MainWindow::on_actionNew_Project_triggered()
         }
         mProject->saveAll();
         updateProjectView();
+        updateSearchIndex();
     }
 }
 
@@ -5381,8 +5429,7 @@ void MainWindow::on_actionRename_Symbol_triggered()
                                       .arg(oldStatement->fullName));
                 return;
             }
-            CppRefacter refactor;
-            refactor.findOccurence(editor,oldCaretXY);
+            mRefacter->findOccurence(editor,oldCaretXY);
             showSearchPanel(true);
             return;
         }
@@ -5402,8 +5449,7 @@ void MainWindow::on_actionRename_Symbol_triggered()
     PCppParser parser = editor->parser();
     //here we must reparse the file in sync, or rename may fail
     parser->parseFile(editor->filename(), editor->inProject(), false, false);
-    CppRefacter refactor;
-    refactor.renameSymbol(editor,oldCaretXY,word,newWord);
+    mRefacter->renameSymbol(editor,oldCaretXY,word,newWord);
     editor->reparse();
 
 }
@@ -5504,32 +5550,8 @@ void MainWindow::on_btnReplace_clicked()
         return;
     }
     QString newWord = ui->cbReplaceInHistory->currentText();
-    foreach (const PSearchResultTreeItem& file, results->results) {
-        QStringList contents;
-        Editor* editor = mEditorList->getEditorByFilename(file->filename);
-        if (!editor) {
-            QMessageBox::critical(this,
-                                  tr("Replace Error"),
-                                  tr("Can't open file '%1' for replace!").arg(file->filename));
-            return;
-        }
-        contents = editor->contents();
-        for (int i=file->results.count()-1;i>=0;i--) {
-            const PSearchResultTreeItem& item = file->results[i];
-            QString line = contents[item->line-1];
-            if (line.mid(item->start-1,results->keyword.length())!=results->keyword) {
-                QMessageBox::critical(editor,
-                            tr("Replace Error"),
-                            tr("Contents has changed since last search!"));
-                return;
-            }
-            line.remove(item->start-1,results->keyword.length());
-            line.insert(item->start-1, newWord);
-            contents[item->line-1] = line;
-        }
-        editor->selectAll();
-        editor->setSelText(contents.join(editor->lineBreak()));
-    }
+    // files not opened are replaced in background, without opening editors for them
+    mFileSearcher->replaceInFiles(results, newWord);
     showSearchReplacePanel(false);
     openCloseBottomPanel(false);
 }
@@ -61,6 +61,8 @@ class Debugger;
 class CPUDialog;
 class QPlainTextEdit;
 class SearchDialog;
+class CppRefacter;
+class FileSearcher;
 class Project;
 class ColorSchemeItem;
 
@@ -149,6 +151,9 @@ public:
 
     SearchResultModel* searchResultModel();
 
+    FileSearcher *fileSearcher() const;
+    void updateSearchIndex();
+
     const std::shared_ptr<CodeCompletionPopup> &completionPopup() const;
 
     const std::shared_ptr<HeaderCompletionPopup> &headerCompletionPopup() const;
@@ -235,6 +240,7 @@ private:
     void scanActiveProject(bool parse=false);
     void includeOrSkipDirs(const QStringList& dirs, bool skip);
     void showSearchReplacePanel(bool show);
+    void updateStopSearchButton();
     void setFilesViewRoot(const QString& path);
     void clearIssues();
     void doCompileRun(RunType runType);
@@ -368,6 +374,8 @@ private slots:
     void on_cbSearchHistory_currentIndexChanged(int index);
 
     void on_btnSearchAgain_clicked();
+
+    void on_btnStopSearch_clicked();
     void on_actionRemove_Watch_triggered();
 
     void on_actionRemove_All_Watches_triggered();
@@ -570,6 +578,8 @@ private:
     Debugger *mDebugger;
     CPUDialog *mCPUDialog;
     SearchDialog *mSearchDialog;
+    CppRefacter *mRefacter;
+    FileSearcher *mFileSearcher;
     bool mQuitting;
     QElapsedTimer mParserTimer;
     QFileSystemWatcher mFileSystemWatcher;
@@ -84,6 +84,13 @@ void CppParser::addHardDefineByLine(const QString &line)
     }
 }
 
+void CppParser::addHardDefines(const PDefineMap &defines)
+{
+    QMutexLocker  locker(&mMutex);
+    if (defines)
+        mPreprocessor.addHardDefines(*defines);
+}
+
 void CppParser::addIncludePath(const QString &value)
 {
     QMutexLocker  locker(&mMutex);
@@ -473,6 +480,46 @@ PStatement CppParser::findStatementOf(const QString &fileName, const QStringList
     return findStatementOf(fileName,expression,findAndScanBlockAt(fileName,line));
 }
 
+bool CppParser::findSymbolReferences(const QString &fileName, const QStringList &contents, const PStatement &statement, SymbolReferenceList &references)
+{
+    // only copy the candidates under the lock, so other threads can use the parser
+    // while the references are checked
+    SymbolReferenceList candidates;
+    QVector<QStringList> expressions;
+    uint contentsHash = referenceContentsHash(contents);
+    {
+        QMutexLocker locker(&mMutex);
+        if (mParsing)
+            return false;
+        PFileIncludes fileIncludes = mPreprocessor.includesList().value(fileName,PFileIncludes());
+        if (!fileIncludes || isSystemHeaderFile(fileName))
+            return false;
+        if (fileIncludes->references.contentsHash != contentsHash)
+            return false;
+        candidates = fileIncludes->references.references.value(statement->command);
+        expressions = fileIncludes->references.expressions;
+    }
+    // references with the same expression in the same scope always refer to the same statement
+    QHash<QPair<int,Statement*>,PStatement> resolved;
+    for (const SymbolReference& reference:candidates) {
+        PStatement scope = findAndScanBlockAt(fileName,reference.line);
+        QPair<int,Statement*> key(reference.expressionId,scope.get());
+        PStatement refStatement;
+        if (resolved.contains(key)) {
+            refStatement = resolved.value(key);
+        } else {
+            refStatement = findStatementOf(fileName, expressions[reference.expressionId], scope);
+            resolved.insert(key,refStatement);
+        }
+        if (refStatement
+                && (refStatement->line == statement->line)
+                && (refStatement->fileName == statement->fileName)) {
+            references.append(reference);
+        }
+    }
+    return true;
+}
+
 PStatement CppParser::findStatementStartingFrom(const QString &fileName, const QString &phrase, const PStatement& startScope)
 {
     PStatement scopeStatement = startScope;
@@ -34,6 +34,7 @@ public:
     ~CppParser();
 
     void addHardDefineByLine(const QString& line);
+    void addHardDefines(const PDefineMap& defines);
     void addFileToScan(const QString& value, bool inProject = false);
     void addIncludePath(const QString& value);
     void addProjectIncludePath(const QString& value);
@@ -72,6 +73,18 @@ public:
     PStatement findStatementOf(const QString& fileName,
                                const QStringList& expression,
                                int line);
+    /**
+     * @brief find references of the statement in the file, using the index built while parsing
+     * @param fileName
+     * @param contents current contents of the file
+     * @param statement
+     * @param references
+     * @return false if the file is not indexed, or the contents are changed since last parse
+     */
+    bool findSymbolReferences(const QString& fileName,
+                              const QStringList& contents,
+                              const PStatement& statement,
+                              SymbolReferenceList& references);
 
     /**
      * @brief evaluate the expression
@@ -124,6 +124,12 @@ void CppPreprocessor::addHardDefineByLine(const QString &line)
     addDefineByLine(line,true);
 }
 
+void CppPreprocessor::addHardDefines(const DefineMap &defines)
+{
+    // defines are not changed after parsed, so it's safe to share them
+    mHardDefines.insert(defines);
+}
+
 void CppPreprocessor::addDefineByLine(const QString &line, bool hardCoded)
 {
     // Remove define
@@ -698,6 +704,12 @@ void CppPreprocessor::openInclude(const QString &fileName, QStringList bufferedT
             } else {
                 parsedFile->buffer = readFileToLines(fileName);
             }
+            // record identifier references for find occurences / rename
+            // (system headers are never searched, so don't waste memory on them)
+            if (!isSystemFile) {
+                mCurrentIncludes->references.clear();
+                collectSymbolReferences(parsedFile->buffer, mCurrentIncludes->references);
+            }
         }
     } else {
         //add defines of already parsed including headers;
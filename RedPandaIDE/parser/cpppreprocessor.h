@@ -65,6 +65,7 @@ public:
     void clearResult();
     void getDefineParts(const QString& input, QString &name, QString &args, QString &value);
     void addHardDefineByLine(const QString& line);
+    void addHardDefines(const DefineMap& defines);
     void reset(); //reset but don't clear generated defines
     void setScanOptions(bool parseSystem, bool parseLocal);
     void preprocess(const QString& fileName, QStringList buffer = QStringList());
@@ -22,6 +22,7 @@
 #include <QDebug>
 #include <QGlobalStatic>
 #include "../utils.h"
+#include "../qsynedit/highlighter/cpp.h"
 
 QStringList CppDirectives;
 QStringList JavadocTags;
@@ -598,3 +599,242 @@ bool isMemberOperator(QString token)
 {
     return MemberOperators.contains(token);
 }
+
+static bool isExpressionIdentChar(const QChar& ch)
+{
+    return ch.isLetterOrNumber() || ch == '_';
+}
+
+/**
+ * @brief add the token before the expression to the expression's head
+ *  (the tokens should be passed from the last one to the first one)
+ * @return false if the token is not a part of the expression and the matching should stop
+ */
+bool prependExpressionToken(const QString &token, ExpressionMatchState &state, QStringList &expression)
+{
+    switch(state.lastSymbolType) {
+    case ExpressionSymbolType::ScopeResolutionOperator: //before '::'
+        if (token==">") {
+            state.lastSymbolType=ExpressionSymbolType::MatchingAngleQuotation;
+            state.symbolMatchingLevel=0;
+        } else if (isExpressionIdentChar(token.front())) {
+            state.lastSymbolType=ExpressionSymbolType::Identifier;
+        } else
+            return false;
+        break;
+    case ExpressionSymbolType::ObjectMemberOperator: //before '.'
+    case ExpressionSymbolType::PointerMemberOperator: //before '->'
+    case ExpressionSymbolType::PointerToMemberOfObjectOperator: //before '.*'
+    case ExpressionSymbolType::PointerToMemberOfPointerOperator: //before '->*'
+        if (token == ")" ) {
+            state.lastSymbolType=ExpressionSymbolType::MatchingParenthesis;
+            state.symbolMatchingLevel = 0;
+        } else if (token == "]") {
+            state.lastSymbolType=ExpressionSymbolType::MatchingBracket;
+            state.symbolMatchingLevel = 0;
+        } else if (isExpressionIdentChar(token.front())) {
+            state.lastSymbolType=ExpressionSymbolType::Identifier;
+        } else
+            return false;
+        break;
+    case ExpressionSymbolType::AsteriskSign: // before '*':
+        if (token == '*') {
+
+        } else
+            return false;
+        break;
+    case ExpressionSymbolType::AmpersandSign: // before '&':
+        return false;
+    case ExpressionSymbolType::ParenthesisMatched: //before '()'
+        if (token == ")" ) {
+            state.lastSymbolType=ExpressionSymbolType::MatchingParenthesis;
+            state.symbolMatchingLevel = 0;
+        } else if (token == "]") {
+            state.lastSymbolType=ExpressionSymbolType::MatchingBracket;
+            state.symbolMatchingLevel = 0;
+        } else if (token == "*") {
+            state.lastSymbolType=ExpressionSymbolType::AsteriskSign;
+        } else if (token == "&") {
+            state.lastSymbolType=ExpressionSymbolType::AmpersandSign;
+        } else if (isExpressionIdentChar(token.front())) {
+            state.lastSymbolType=ExpressionSymbolType::Identifier;
+        } else
+            return false;
+        break;
+    case ExpressionSymbolType::BracketMatched: //before '[]'
+        if (token == ")" ) {
+            state.lastSymbolType=ExpressionSymbolType::MatchingParenthesis;
+            state.symbolMatchingLevel = 0;
+        } else if (token == "]") {
+            state.lastSymbolType=ExpressionSymbolType::MatchingBracket;
+            state.symbolMatchingLevel = 0;
+        } else if (isExpressionIdentChar(token.front())) {
+            state.lastSymbolType=ExpressionSymbolType::Identifier;
+        } else
+            return false;
+        break;
+    case ExpressionSymbolType::AngleQuotationMatched: //before '<>'
+        if (isExpressionIdentChar(token.front())) {
+            state.lastSymbolType=ExpressionSymbolType::Identifier;
+        } else
+            return false;
+        break;
+    case ExpressionSymbolType::None:
+        if (token =="::") {
+            state.lastSymbolType=ExpressionSymbolType::ScopeResolutionOperator;
+        } else if (token == ".") {
+            state.lastSymbolType=ExpressionSymbolType::ObjectMemberOperator;
+        } else if (token=="->") {
+            state.lastSymbolType = ExpressionSymbolType::PointerMemberOperator;
+        } else if (token == ".*") {
+            state.lastSymbolType = ExpressionSymbolType::PointerToMemberOfObjectOperator;
+        } else if (token == "->*"){
+            state.lastSymbolType = ExpressionSymbolType::PointerToMemberOfPointerOperator;
+        } else if (token == ")" ) {
+            state.lastSymbolType=ExpressionSymbolType::MatchingParenthesis;
+            state.symbolMatchingLevel = 0;
+        } else if (token == "]") {
+            state.lastSymbolType=ExpressionSymbolType::MatchingBracket;
+            state.symbolMatchingLevel = 0;
+        } else if (isExpressionIdentChar(token.front())) {
+            state.lastSymbolType=ExpressionSymbolType::Identifier;
+        } else
+            return false;
+        break;
+    case ExpressionSymbolType::TildeSign:
+        if (token =="::") {
+            state.lastSymbolType=ExpressionSymbolType::ScopeResolutionOperator;
+        } else {
+            // "~" must appear after "::"
+            expression.pop_front();
+            return false;
+        }
+        break;
+    case ExpressionSymbolType::Identifier:
+        if (token =="::") {
+            state.lastSymbolType=ExpressionSymbolType::ScopeResolutionOperator;
+        } else if (token == ".") {
+            state.lastSymbolType=ExpressionSymbolType::ObjectMemberOperator;
+        } else if (token=="->") {
+            state.lastSymbolType = ExpressionSymbolType::PointerMemberOperator;
+        } else if (token == ".*") {
+            state.lastSymbolType = ExpressionSymbolType::PointerToMemberOfObjectOperator;
+        } else if (token == "->*"){
+            state.lastSymbolType = ExpressionSymbolType::PointerToMemberOfPointerOperator;
+        } else if (token == "~") {
+            state.lastSymbolType=ExpressionSymbolType::TildeSign;
+        } else if (token == "*") {
+            state.lastSymbolType=ExpressionSymbolType::AsteriskSign;
+        } else if (token == "&") {
+            state.lastSymbolType=ExpressionSymbolType::AmpersandSign;
+        } else
+            return false; // stop matching;
+        break;
+    case ExpressionSymbolType::MatchingParenthesis:
+        if (token=="(") {
+            if (state.symbolMatchingLevel==0) {
+                state.lastSymbolType=ExpressionSymbolType::ParenthesisMatched;
+            } else {
+                state.symbolMatchingLevel--;
+            }
+        } else if (token==")") {
+            state.symbolMatchingLevel++;
+        }
+        break;
+    case ExpressionSymbolType::MatchingBracket:
+        if (token=="[") {
+            if (state.symbolMatchingLevel==0) {
+                state.lastSymbolType=ExpressionSymbolType::BracketMatched;
+            } else {
+                state.symbolMatchingLevel--;
+            }
+        } else if (token=="]") {
+            state.symbolMatchingLevel++;
+        }
+        break;
+    case ExpressionSymbolType::MatchingAngleQuotation:
+        if (token=="<") {
+            if (state.symbolMatchingLevel==0) {
+                state.lastSymbolType=ExpressionSymbolType::AngleQuotationMatched;
+            } else {
+                state.symbolMatchingLevel--;
+            }
+        } else if (token==">") {
+            state.symbolMatchingLevel++;
+        }
+        break;
+    }
+    expression.push_front(token);
+    return true;
+}
+
+uint referenceContentsHash(const QStringList &contents)
+{
+    // line breaks, trailing spaces and trailing empty lines don't change the positions of the references,
+    // and they differ between the parsed file and the editor's contents
+    int count = contents.count();
+    while (count>0 && trimRight(contents[count-1]).isEmpty())
+        count--;
+    uint hash = 0;
+    for (int i=0;i<count;i++)
+        hash = qHash(trimRight(contents[i]),hash);
+    return hash;
+}
+
+void SymbolReferenceIndex::clear()
+{
+    references.clear();
+    expressions.clear();
+    contentsHash = 0;
+}
+
+struct ReferenceToken {
+    QString text;
+    int line;
+    int start;
+    bool isIdentifier;
+};
+
+void collectSymbolReferences(const QStringList &buffer, SymbolReferenceIndex &index)
+{
+    // use the same tokens as Editor::getExpressionAtPosition
+    SynEditCppHighlighter highlighter;
+    QVector<ReferenceToken> tokens;
+    highlighter.resetState();
+    for (int i=0;i<buffer.count();i++) {
+        highlighter.setLine(buffer[i],i);
+        while (!highlighter.eol()) {
+            PSynHighlighterAttribute attr = highlighter.getTokenAttribute();
+            if (attr!=highlighter.commentAttribute() && attr!=highlighter.whitespaceAttribute()) {
+                tokens.append({highlighter.getToken(),
+                               i+1,
+                               highlighter.getTokenPos()+1,
+                               attr==highlighter.identifierAttribute()});
+            }
+            highlighter.next();
+        }
+    }
+
+    index.contentsHash = referenceContentsHash(buffer);
+    QHash<QString,int> expressionIds;
+    for (int i=0;i<tokens.count();i++) {
+        const ReferenceToken& token = tokens[i];
+        if (!token.isIdentifier)
+            continue;
+        ExpressionMatchState state;
+        QStringList expression;
+        for (int j=i;j>=0;j--) {
+            if (!prependExpressionToken(tokens[j].text,state,expression))
+                break;
+        }
+        // tokens never contain line breaks, so the joined text is unique for each expression
+        QString key = expression.join('\n');
+        int expressionId = expressionIds.value(key,-1);
+        if (expressionId<0) {
+            expressionId = index.expressions.count();
+            index.expressions.append(expression);
+            expressionIds.insert(key,expressionId);
+        }
+        index.references[token.text].append({token.line,token.start,expressionId});
+    }
+}
@@ -19,6 +19,7 @@
 #include <QMap>
 #include <QObject>
 #include <QSet>
+#include <QVector>
 #include <memory>
 
 struct CodeSnippet {
@@ -208,6 +209,45 @@ struct CppScope {
 };
 
 using PCppScope = std::shared_ptr<CppScope>;
+
+struct SymbolReference {
+    int line; // line of the reference (starts from 1)
+    int start; // start char of the reference in the line (starts from 1)
+    int expressionId; // index of the full expression ended by the reference (such as s.name) in SymbolReferenceIndex::expressions
+};
+using SymbolReferenceList = QVector<SymbolReference>;
+
+struct SymbolReferenceIndex {
+    QHash<QString, SymbolReferenceList> references; // references in a file (identifier as key)
+    QVector<QStringList> expressions; // distinct expressions of the references
+    uint contentsHash = 0; // hash of the contents the references are collected from
+    void clear();
+};
+
+enum class ExpressionSymbolType {
+    Identifier,
+    ScopeResolutionOperator, //'::'
+    ObjectMemberOperator, //'.'
+    PointerMemberOperator, //'->'
+    PointerToMemberOfObjectOperator, //'.*'
+    PointerToMemberOfPointerOperator, //'->*'
+    MatchingBracket,
+    BracketMatched,
+    MatchingParenthesis,
+    ParenthesisMatched,
+    TildeSign,    // '~'
+    AsteriskSign, // '*'
+    AmpersandSign, // '&'
+    MatchingAngleQuotation,
+    AngleQuotationMatched,
+    None
+};
+
+struct ExpressionMatchState {
+    ExpressionSymbolType lastSymbolType = ExpressionSymbolType::None;
+    int symbolMatchingLevel = 0;
+};
+
 class CppScopes {
 
 public:
@@ -229,6 +269,7 @@ struct FileIncludes {
     CppScopes scopes; // int is start line of the statement scope
     QSet<QString> dependingFiles; // The files I depeneds on
     QSet<QString> dependedFiles; // the files depends on me
+    SymbolReferenceIndex references; // identifiers referenced in this file
 };
 using PFileIncludes = std::shared_ptr<FileIncludes>;
 using ColorCallback = std::function<QColor (PStatement)>;
@@ -262,5 +303,8 @@ QStringList getOwnerExpressionAndMember(
         QString& memberOperator,
         QStringList& memberExpression);
 bool isMemberOperator(QString token);
+uint referenceContentsHash(const QStringList& contents);
+bool prependExpressionToken(const QString& token, ExpressionMatchState& state, QStringList& expression);
+void collectSymbolReferences(const QStringList& buffer, SymbolReferenceIndex& index);
 
 #endif // PARSER_UTILS_H
@@ -127,6 +127,11 @@ void SynEditFoldRanges::remove(int index)
     mRanges.remove(index);
 }
 
+void SynEditFoldRanges::remove(const PSynEditFoldRange &range)
+{
+    mRanges.removeOne(range);
+}
+
 void SynEditFoldRanges::add(PSynEditFoldRange foldRange)
 {
     mRanges.push_back(foldRange);
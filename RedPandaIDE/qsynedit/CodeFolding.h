@@ -72,6 +72,7 @@ public:
 
     void insert(int index, PSynEditFoldRange range);
     void remove(int index);
+    void remove(const PSynEditFoldRange& range);
     void add(PSynEditFoldRange foldRange);
     PSynEditFoldRange operator[](int index) const;
 };
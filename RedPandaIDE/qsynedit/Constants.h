@@ -29,6 +29,15 @@ extern const QChar SynSoftBreakGlyph;
 
 #define MAX_SCROLL 65535
 
+//pasting at least this many lines inserts them all at once, without auto indenting them
+#define BULK_INSERT_LINES 1000
+
+//lines searched at a time when looking for the next match
+#define SEARCH_CHUNK_LINES 1000
+
+//bytes of a mapped file scanned between two checks of its size
+#define MAPPED_FILE_CHECK_STEP (1024*1024)
+
 #define SYN_ATTR_COMMENT    0
 #define SYN_ATTR_IDENTIFIER 1
 #define SYN_ATTR_KEYWORD    2
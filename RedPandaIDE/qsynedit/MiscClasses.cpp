@@ -16,6 +16,8 @@
  */
 #include "MiscClasses.h"
 #include "algorithm"
+#include <QPainter>
+#include <QStyleOptionSlider>
 
 SynGutter::SynGutter(QObject *parent):
     QObject(parent)
@@ -507,3 +509,41 @@ void SynBookMarkOpt::setXOffset(int xOffset)
         emit changed();
     }
 }
+
+SynEditScrollBar::SynEditScrollBar(Qt::Orientation orientation, QWidget *parent):
+    QScrollBar(orientation,parent),
+    mLineCount(0)
+{
+
+}
+
+void SynEditScrollBar::setMarks(const QVector<int> &marks, int lineCount, const QColor &color)
+{
+    if (mMarks.isEmpty() && marks.isEmpty())
+        return;
+    mMarks = marks;
+    mLineCount = lineCount;
+    mMarkColor = color;
+    update();
+}
+
+void SynEditScrollBar::paintEvent(QPaintEvent *event)
+{
+    QScrollBar::paintEvent(event);
+    if (mMarks.isEmpty() || mLineCount<=0)
+        return;
+    QStyleOptionSlider opt;
+    initStyleOption(&opt);
+    QRect groove = style()->subControlRect(QStyle::CC_ScrollBar, &opt,
+                                           QStyle::SC_ScrollBarGroove, this);
+    QPainter painter(this);
+    int lastY = -1;
+    for (int line:mMarks) {
+        int y = groove.top() + (int)((qint64)line * groove.height() / mLineCount);
+        // many marks fall on the same pixel row in big files
+        if (y == lastY)
+            continue;
+        lastY = y;
+        painter.fillRect(groove.left()+2, y, groove.width()-4, 2, mMarkColor);
+    }
+}
@@ -20,6 +20,7 @@
 #include <QColor>
 #include <QFont>
 #include <QObject>
+#include <QScrollBar>
 #include "Types.h"
 
 enum class SynGutterBorderStyle {
@@ -200,4 +201,21 @@ private:
 };
 
 using PSynBookMarkOpt = std::shared_ptr<SynBookMarkOpt>;
+
+/*
+ * Scroll bar showing tick marks at the lines of the highlighted matches.
+ */
+class SynEditScrollBar : public QScrollBar {
+    Q_OBJECT
+public:
+    explicit SynEditScrollBar(Qt::Orientation orientation, QWidget* parent = nullptr);
+    // marks are sorted 0-based indexes of the lineCount lines
+    void setMarks(const QVector<int>& marks, int lineCount, const QColor& color);
+protected:
+    void paintEvent(QPaintEvent *event) override;
+private:
+    QVector<int> mMarks;
+    int mLineCount;
+    QColor mMarkColor;
+};
 #endif // MISCCLASSES_H
@@ -48,11 +48,7 @@ int SynSearch::findAll(const QString &text)
     int start=0;
     int next=-1;
     while (true) {
-        if (options().testFlag(ssoMatchCase)) {
-            next = text.indexOf(pattern(),start,Qt::CaseSensitive);
-        } else {
-            next = text.indexOf(pattern(),start,Qt::CaseInsensitive);
-        }
+        next = mMatcher.indexIn(text,start);
         if (next<0) {
             break;
         }
@@ -77,6 +73,21 @@ QString SynSearch::replace(const QString &, const QString &aReplacement)
     return aReplacement;
 }
 
+void SynSearch::setPattern(const QString &value)
+{
+    SynSearchBase::setPattern(value);
+    mMatcher.setPattern(value);
+}
+
+void SynSearch::setOptions(const SynSearchOptions &options)
+{
+    SynSearchBase::setOptions(options);
+    if (options.testFlag(ssoMatchCase))
+        mMatcher.setCaseSensitivity(Qt::CaseSensitive);
+    else
+        mMatcher.setCaseSensitivity(Qt::CaseInsensitive);
+}
+
 bool SynSearch::isDelimitChar(QChar ch)
 {
     return !(ch == '_' || ch.isLetterOrNumber());
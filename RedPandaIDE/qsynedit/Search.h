@@ -17,6 +17,7 @@
 #ifndef SYNSEARCH_H
 #define SYNSEARCH_H
 #include "SearchBase.h"
+#include <QStringMatcher>
 
 
 class SynSearch : public SynSearchBase
@@ -32,10 +33,14 @@ public:
     int resultCount() override;
     int findAll(const QString &text) override;
     QString replace(const QString &aOccurrence, const QString &aReplacement) override;
+    void setPattern(const QString &value) override;
+    void setOptions(const SynSearchOptions &options) override;
 private:
     bool isDelimitChar(QChar ch);
 private:
     QList<int> mResults;
+    // keeps the skip table of the pattern between searches
+    QStringMatcher mMatcher;
 };
 
 #endif // SYNSEARCH_H
@@ -15,6 +15,7 @@
  * along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
 #include "SearchBase.h"
+#include <algorithm>
 
 SynSearchBase::SynSearchBase(QObject *parent) : QObject(parent)
 {
@@ -40,3 +41,44 @@ void SynSearchBase::setOptions(const SynSearchOptions &options)
 {
     mOptions = options;
 }
+
+QVector<SynSearchMatch> SynSearchBase::findAllInLines(const QStringList &lines, int firstLine)
+{
+    QVector<SynSearchMatch> matches;
+    if (lines.isEmpty())
+        return matches;
+    // join the lines, and remember where each of them starts in the text
+    QVector<int> lineStarts;
+    lineStarts.reserve(lines.count());
+    int textLength = 0;
+    for (const QString& line:lines)
+        textLength += line.length()+1;
+    QString text;
+    text.reserve(textLength);
+    for (int i=0;i<lines.count();i++) {
+        if (i>0)
+            text.append('\n');
+        lineStarts.append(text.length());
+        text.append(lines[i]);
+    }
+    int count = findAll(text);
+    matches.reserve(count);
+    // the results are in text order, so map them to lines in one sweep
+    int startIndex = 0;
+    for (int i=0;i<count;i++) {
+        int start = result(i);
+        int length = std::max(0,this->length(i));
+        int end = start + length;
+        while (startIndex+1<lineStarts.count() && lineStarts[startIndex+1]<=start)
+            startIndex++;
+        int endIndex = startIndex;
+        while (endIndex+1<lineStarts.count() && lineStarts[endIndex+1]<=end)
+            endIndex++;
+        SynSearchMatch match;
+        match.start = BufferCoord{start-lineStarts[startIndex]+1, startIndex+firstLine};
+        match.end = BufferCoord{end-lineStarts[endIndex]+1, endIndex+firstLine};
+        match.length = length;
+        matches.append(match);
+    }
+    return matches;
+}
@@ -18,7 +18,10 @@
 #define SYNSEARCHBASE_H
 
 #include <QObject>
+#include <QStringList>
+#include <QVector>
 #include <memory>
+#include "Types.h"
 
 enum SynSearchOption {
     ssoMatchCase    = 0x0001,
@@ -32,6 +35,13 @@ enum SynSearchOption {
 Q_DECLARE_FLAGS(SynSearchOptions, SynSearchOption)
 Q_DECLARE_OPERATORS_FOR_FLAGS(SynSearchOptions)
 
+// a match found in the editor's lines, it may span several lines
+struct SynSearchMatch {
+    BufferCoord start;
+    BufferCoord end; // the position after the last matched char
+    int length; // matched chars, a line break counts as one char
+};
+
 class SynSearchBase : public QObject
 {
     Q_OBJECT
@@ -44,6 +54,9 @@ public:
     virtual int resultCount() = 0;
     virtual int findAll(const QString& text) = 0;
     virtual QString replace(const QString& aOccurrence, const QString& aReplacement) = 0;
+    // Find all matches in the lines, they are searched as one text joined by '\n',
+    // so a match can span lines. firstLine is the line number of lines[0].
+    QVector<SynSearchMatch> findAllInLines(const QStringList& lines, int firstLine = 1);
     SynSearchOptions options() const;
     virtual void setOptions(const SynSearchOptions &options);
 
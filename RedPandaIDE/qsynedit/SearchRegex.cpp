@@ -78,6 +78,10 @@ void SynSearchRegex::setOptions(const SynSearchOptions &options)
 
 void SynSearchRegex::updateRegexOptions()
 {
+    // ^ and $ match at line breaks when searching in several lines at once
+    mRegex.setPatternOptions(
+                mRegex.patternOptions() |
+                QRegularExpression::MultilineOption);
     if (options().testFlag(SynSearchOption::ssoMatchCase)) {
         mRegex.setPatternOptions(
                     mRegex.patternOptions() &
@@ -87,4 +91,6 @@ void SynSearchRegex::updateRegexOptions()
                     mRegex.patternOptions() |
                     QRegularExpression::CaseInsensitiveOption);
     }
+    // compile the pattern now, it's used for the whole text
+    mRegex.optimize();
 }
@@ -27,6 +27,8 @@
 #include "highlighter/base.h"
 #include "Constants.h"
 #include "TextPainter.h"
+#include "Search.h"
+#include "SearchRegex.h"
 #include <QClipboard>
 #include <QDebug>
 #include <QGuiApplication>
@@ -38,6 +40,9 @@
 #include <QDrag>
 #include <QMimeData>
 #include <QDesktopWidget>
+#include <QElapsedTimer>
+#include <QMap>
+#include <QSet>
 
 SynEdit::SynEdit(QWidget *parent) : QAbstractScrollArea(parent)
 {
@@ -138,17 +143,40 @@ SynEdit::SynEdit(QWidget *parent) : QAbstractScrollArea(parent)
             | eoDragDropEditing | eoEnhanceEndKey | eoTabIndent |
              eoGroupUndo | eoKeepCaretX | eoSelectWordByDblClick
             | eoHideShowScrollbars ;
+    mUndoList->setGroupUndo(mOptions.testFlag(eoGroupUndo));
 
     mScrollTimer = new QTimer(this);
     //mScrollTimer->setInterval(100);
     connect(mScrollTimer, &QTimer::timeout,this, &SynEdit::onScrollTimeout);
 
+    mRangeScanTimer = new QTimer(this);
+    mRangeScanTimer->setSingleShot(true);
+    mRangeScanTimer->setInterval(0);
+    connect(mRangeScanTimer, &QTimer::timeout,this, &SynEdit::onRangeScanTimeout);
+
+    mMatchSerial = 0;
+    mMatchScanLine = 0;
+    mMatchScanTimer = new QTimer(this);
+    mMatchScanTimer->setSingleShot(true);
+    mMatchScanTimer->setInterval(0);
+    connect(mMatchScanTimer, &QTimer::timeout,this, &SynEdit::onMatchScanTimeout);
+
     mScrollHintColor = QColorConstants::Yellow;
     mScrollHintFormat = SynScrollHintFormat::shfTopLineOnly;
 
     mContentImage = std::make_shared<QImage>(clientWidth(),clientHeight(),QImage::Format_ARGB32);
 
     mUseCodeFolding = true;
+    mFoldsDirtyFrom = INT_MAX;
+    mFoldsDirtyTo = -1;
+    mFoldIndexValid = false;
+    mBracketIndexValid = false;
+    mBracketIndexSize = 0;
+    mBracketIndexCount = 0;
+    mBracketLeavesDirtyFrom = INT_MAX;
+    mBracketLeavesDirtyTo = -1;
+    mBracketNodesDirtyFrom = INT_MAX;
+    mBracketNodesDirtyTo = -1;
     m_blinkTimerId = 0;
     m_blinkStatus = 0;
 
@@ -156,6 +184,8 @@ SynEdit::SynEdit(QWidget *parent) : QAbstractScrollArea(parent)
 
     hideCaret();
 
+    mVerticalScrollBar = new SynEditScrollBar(Qt::Vertical,this);
+    setVerticalScrollBar(mVerticalScrollBar);
     connect(horizontalScrollBar(),&QScrollBar::valueChanged,
             this, &SynEdit::onScrolled);
     connect(verticalScrollBar(),&QScrollBar::valueChanged,
@@ -377,28 +407,22 @@ bool SynEdit::getHighlighterAttriAtRowCol(const BufferCoord &XY, QString &Token,
     PosY = XY.Line - 1;
     if (mHighlighter && (PosY >= 0) && (PosY < mLines->count())) {
         Line = mLines->getString(PosY);
-        if (PosY == 0) {
-            mHighlighter->resetState();
-        } else {
-            mHighlighter->setState(mLines->ranges(PosY-1));
-        }
-        mHighlighter->setLine(Line, PosY);
         PosX = XY.Char;
         if ((PosX > 0) && (PosX <= Line.length())) {
-            while (!mHighlighter->eol()) {
-                Start = mHighlighter->getTokenPos() + 1;
-                Token = mHighlighter->getToken();
-                endPos = Start + Token.length()-1;
+            PSynEditLineTokens tokens = lineTokens(PosY);
+            for (const SynEditLineToken& token:tokens->tokens) {
+                Start = token.pos + 1;
+                endPos = Start + token.length-1;
                 if ((PosX >= Start) && (PosX <= endPos)) {
-                    Attri = mHighlighter->getTokenAttribute();
+                    Token = Line.mid(token.pos,token.length);
+                    Attri = token.attr;
                     if (PosX == endPos)
-                        tokenFinished = mHighlighter->getTokenFinished();
+                        tokenFinished = token.finished;
                     else
                         tokenFinished = false;
-                    TokenType = mHighlighter->getTokenType();
+                    TokenType = token.type;
                     return true;
                 }
-                mHighlighter->next();
             }
         }
     }
@@ -415,25 +439,19 @@ bool SynEdit::getHighlighterAttriAtRowColEx(const BufferCoord &XY, QString &Toke
     PosY = XY.Line - 1;
     if (mHighlighter && (PosY >= 0) && (PosY < mLines->count())) {
         Line = mLines->getString(PosY);
-        if (PosY == 0) {
-            mHighlighter->resetState();
-        } else {
-            mHighlighter->setState(mLines->ranges(PosY-1));
-        }
-        mHighlighter->setLine(Line, PosY);
         PosX = XY.Char;
         if ((PosX > 0) && (PosX <= Line.length())) {
-            while (!mHighlighter->eol()) {
-                Start = mHighlighter->getTokenPos() + 1;
-                Token = mHighlighter->getToken();
-                endPos = Start + Token.length()-1;
+            PSynEditLineTokens tokens = lineTokens(PosY);
+            for (const SynEditLineToken& token:tokens->tokens) {
+                Start = token.pos + 1;
+                endPos = Start + token.length-1;
                 if ((PosX >= Start) && (PosX <= endPos)) {
-                    Attri = mHighlighter->getTokenAttribute();
-                    TokenKind = mHighlighter->getTokenKind();
-                    TokenType = mHighlighter->getTokenType();
+                    Token = Line.mid(token.pos,token.length);
+                    Attri = token.attr;
+                    TokenKind = token.kind;
+                    TokenType = token.type;
                     return true;
                 }
-                mHighlighter->next();
             }
         }
     }
@@ -485,6 +503,16 @@ BufferCoord SynEdit::getMatchingBracketEx(BufferCoord APoint)
         // is it one of the recognized brackets?
         for (i = 0; i<nBrackets; i++) {
             if (Test == Brackets[i]) {
+                // the cpp highlighter keeps the levels of (), [] and {}, so the index can find the matching line
+                if (i<6 && ensureBracketIndex()) {
+                    bool found;
+                    if (i%2==1)
+                        found = findOpenBracket(i/2, PosY-1, PosX-1, true, p);
+                    else
+                        found = findCloseBracket(i/2, PosY-1, PosX-1, p);
+                    if (found)
+                        return p;
+                }
                 // this is the bracket, get the matching one and the direction
                 BracketInc = Brackets[i];
                 BracketDec = Brackets[i ^ 1]; // 0 -> 1, 1 -> 0, ...
@@ -809,8 +837,7 @@ QString SynEdit::GetLeftSpacing(int charCount, bool wantTabs) const
 int SynEdit::charToColumn(int aLine, int aChar) const
 {
     if (aLine>=1 && aLine <= mLines->count()) {
-        QString s = mLines->getString(aLine - 1);
-        return charToColumn(s,aChar);
+        return mLines->charsColumns(aLine-1, aChar-1)+1;
     }
     return aChar;
 }
@@ -832,20 +859,7 @@ int SynEdit::columnToChar(int aLine, int aColumn) const
 {
     Q_ASSERT( (aLine <= mLines->count()) && (aLine >= 1));
     if (aLine <= mLines->count()) {
-        QString s = mLines->getString(aLine - 1);
-        int x = 0;
-        int len = s.length();
-        int i;
-        for (i=0;i<len;i++) {
-            if (s[i] == '\t')
-                x+=mTabWidth - (x % mTabWidth);
-            else
-                x+=charColumns(s[i]);
-            if (x>=aColumn) {
-                break;
-            }
-        }
-        return i+1;
+        return mLines->columnToCharIndex(aLine-1, aColumn)+1;
     }
     return aColumn;
 }
@@ -853,15 +867,17 @@ int SynEdit::columnToChar(int aLine, int aColumn) const
 int SynEdit::stringColumns(const QString &line, int colsBefore) const
 {
     int columns = std::max(0,colsBefore);
-    int charCols;
-    for (int i=0;i<line.length();i++) {
-        QChar ch = line[i];
+    const QChar* chars = line.constData();
+    int len = line.length();
+    for (int i=0;i<len;i++) {
+        ushort ch = chars[i].unicode();
         if (ch == '\t') {
-            charCols = mTabWidth - columns % mTabWidth;
+            columns += mTabWidth - columns % mTabWidth;
+        } else if (ch < 128) {
+            columns += mAsciiCharColumns[ch];
         } else {
-            charCols = charColumns(ch);
+            columns += charColumns(chars[i]);
         }
-        columns+=charCols;
     }
     return columns-colsBefore;
 }
@@ -900,31 +916,367 @@ int SynEdit::lineToRow(int aLine) const
 
 int SynEdit::foldRowToLine(int Row) const
 {
-    int result = Row;
+    ensureFoldIndex();
+    // folds whose first line is shown above Row
+    int count = std::lower_bound(mFoldIndexRows.begin(),mFoldIndexRows.end(),Row)
+            - mFoldIndexRows.begin();
+    return Row + mFoldIndexCollapsedBefore[count];
+}
+
+int SynEdit::foldLineToRow(int Line) const
+{
+    ensureFoldIndex();
+    // folds that end before Line
+    int count = std::lower_bound(mFoldIndexToLines.begin(),mFoldIndexToLines.end(),Line)
+            - mFoldIndexToLines.begin();
+    int result = Line - mFoldIndexCollapsedBefore[count];
+    // Inside fold
+    if (count < mFoldIndexFromLines.count() && mFoldIndexFromLines[count] < Line)
+        result -= Line - mFoldIndexFromLines[count];
+    return result;
+}
+
+void SynEdit::invalidateFoldIndex()
+{
+    mFoldIndexValid = false;
+}
+
+void SynEdit::ensureFoldIndex() const
+{
+    if (mFoldIndexValid)
+        return;
+    mFoldIndexFromLines.clear();
+    mFoldIndexToLines.clear();
+    mFoldIndexRows.clear();
+    mFoldIndexCollapsedBefore.clear();
+    int collapsedBefore = 0;
+    // visible collapsed folds don't overlap, and mAllFoldRanges is sorted by line
     for (int i=0;i<mAllFoldRanges.count();i++) {
         PSynEditFoldRange range = mAllFoldRanges[i];
-        if (range->collapsed && !range->parentCollapsed() && range->fromLine < result) {
-            result += range->linesCollapsed;
+        if (range->collapsed && !range->parentCollapsed()) {
+            mFoldIndexFromLines.append(range->fromLine);
+            mFoldIndexToLines.append(range->toLine);
+            mFoldIndexRows.append(range->fromLine - collapsedBefore);
+            mFoldIndexCollapsedBefore.append(collapsedBefore);
+            collapsedBefore += range->linesCollapsed;
         }
     }
+    mFoldIndexCollapsedBefore.append(collapsedBefore);
+    mFoldIndexValid = true;
+}
+
+void SynEdit::invalidateBracketIndex()
+{
+    mBracketIndexValid = false;
+}
+
+void SynEdit::markBracketIndexDirty(int fromLine, int toLine)
+{
+    mBracketLeavesDirtyFrom = std::min(mBracketLeavesDirtyFrom, fromLine);
+    mBracketLeavesDirtyTo = std::max(mBracketLeavesDirtyTo, toLine);
+    mBracketNodesDirtyFrom = std::min(mBracketNodesDirtyFrom, fromLine);
+    mBracketNodesDirtyTo = std::max(mBracketNodesDirtyTo, toLine);
+}
+
+void SynEdit::bracketIndexLinesInserted(int index, int count)
+{
+    if (!mBracketIndexValid)
+        return;
+    int oldCount = mBracketIndexCount;
+    int newCount = oldCount + count;
+    if (index > oldCount || newCount > mBracketIndexSize) {
+        //the trees are rebuilt with more leaves
+        invalidateBracketIndex();
+        return;
+    }
+    for (int kind=0;kind<3;kind++) {
+        int* leaves = mBracketIndex[kind].data() + mBracketIndexSize;
+        std::copy_backward(leaves+index, leaves+oldCount, leaves+newCount);
+        std::fill(leaves+index, leaves+index+count, INT_MAX);
+    }
+    mBracketIndexCount = newCount;
+    if (mBracketLeavesDirtyFrom >= index && mBracketLeavesDirtyFrom < INT_MAX)
+        mBracketLeavesDirtyFrom += count;
+    if (mBracketLeavesDirtyTo >= index)
+        mBracketLeavesDirtyTo += count;
+    //the brace leaf of the line after the inserted ones depends on the last inserted line
+    markBracketIndexDirty(index, index+count);
+    //the leaves after them are moved, so are their nodes
+    mBracketNodesDirtyTo = std::max(mBracketNodesDirtyTo, newCount-1);
+}
+
+void SynEdit::bracketIndexLinesDeleted(int index, int count)
+{
+    if (!mBracketIndexValid)
+        return;
+    int oldCount = mBracketIndexCount;
+    if (index+count > oldCount) {
+        invalidateBracketIndex();
+        return;
+    }
+    int newCount = oldCount - count;
+    for (int kind=0;kind<3;kind++) {
+        int* leaves = mBracketIndex[kind].data() + mBracketIndexSize;
+        std::copy(leaves+index+count, leaves+oldCount, leaves+index);
+        std::fill(leaves+newCount, leaves+oldCount, INT_MAX);
+    }
+    mBracketIndexCount = newCount;
+    if (mBracketLeavesDirtyFrom >= index+count && mBracketLeavesDirtyFrom < INT_MAX)
+        mBracketLeavesDirtyFrom -= count;
+    else if (mBracketLeavesDirtyFrom > index && mBracketLeavesDirtyFrom < INT_MAX)
+        mBracketLeavesDirtyFrom = index;
+    if (mBracketLeavesDirtyTo >= index+count)
+        mBracketLeavesDirtyTo -= count;
+    else if (mBracketLeavesDirtyTo >= index)
+        mBracketLeavesDirtyTo = index;
+    //the brace leaf of the line after the deleted ones depends on the line before them
+    markBracketIndexDirty(index, index);
+    mBracketNodesDirtyTo = std::max(mBracketNodesDirtyTo, oldCount-1);
+}
+
+static int rangeBracketLevel(const SynRangeState& range, int kind)
+{
+    switch(kind) {
+    case 0:
+        return range.parenthesisLevel;
+    case 1:
+        return range.bracketLevel;
+    default:
+        return range.braceLevel;
+    }
+}
+
+// the last line before "before" whose lowest level is below level, -1 if none
+static int findLastLineBelow(const QVector<int>& tree, int node, int from, int to, int before, int level)
+{
+    if (from >= before || tree[node] >= level)
+        return -1;
+    if (to - from == 1)
+        return from;
+    int mid = (from + to) / 2;
+    int result = findLastLineBelow(tree, node*2+1, mid, to, before, level);
+    if (result < 0)
+        result = findLastLineBelow(tree, node*2, from, mid, before, level);
     return result;
 }
 
-int SynEdit::foldLineToRow(int Line) const
+// the first line between "after" and "before" whose lowest level is below level, -1 if none
+static int findFirstLineBelow(const QVector<int>& tree, int node, int from, int to, int after, int before, int level)
 {
-    int result = Line;
-    for (int i=mAllFoldRanges.count()-1;i>=0;i--) {
-        PSynEditFoldRange range =mAllFoldRanges[i];
-        if (range->collapsed && !range->parentCollapsed()) {
-            // Line is found after fold
-            if (range->toLine < Line)
-                result -= range->linesCollapsed;
-            // Inside fold
-            else if (range->fromLine < Line && Line <= range->toLine)
-                result -= Line - range->fromLine;
+    if (to <= after+1 || from >= before || tree[node] >= level)
+        return -1;
+    if (to - from == 1)
+        return from;
+    int mid = (from + to) / 2;
+    int result = findFirstLineBelow(tree, node*2, from, mid, after, before, level);
+    if (result < 0)
+        result = findFirstLineBelow(tree, node*2+1, mid, to, after, before, level);
+    return result;
+}
+
+/*
+ * Brings the bracket index up to date: the leaves of the lines whose ranges are changed
+ * are recomputed, and the nodes above them. Lines not scanned yet have no leaves, the
+ * searches fall back to scanning the text when they reach them.
+ * Returns false if the highlighter doesn't keep the bracket levels in the ranges.
+ */
+bool SynEdit::ensureBracketIndex()
+{
+    if (!mHighlighter || mHighlighter->getClass() != SynHighlighterClass::CppHighlighter
+            || mLines->mapped() || mLines->empty())
+        return false;
+    int count = mLines->count();
+    if (!mBracketIndexValid || mBracketIndexCount != count) {
+        int size = 1;
+        while (size < count)
+            size *= 2;
+        mBracketIndexSize = size;
+        mBracketIndexCount = count;
+        for (int kind=0;kind<3;kind++)
+            mBracketIndex[kind].fill(INT_MAX, 2*size);
+        mBracketLeavesDirtyFrom = 0;
+        mBracketLeavesDirtyTo = count-1;
+        mBracketNodesDirtyFrom = 0;
+        mBracketNodesDirtyTo = size-1;
+        mBracketIndexValid = true;
+    }
+    int size = mBracketIndexSize;
+    if (mBracketNodesDirtyFrom > std::min(mBracketNodesDirtyTo, size-1))
+        return true;
+    int firstUnscanned = mLines->firstUnscannedLine();
+    int last = std::min(mBracketLeavesDirtyTo, count-1);
+    for (int i=mBracketLeavesDirtyFrom;i<=last;i++) {
+        if (i >= firstUnscanned) {
+            //it's marked dirty again when scanned
+            for (int kind=0;kind<3;kind++)
+                mBracketIndex[kind][size+i] = INT_MAX;
+            continue;
+        }
+        PSynRangeState range = mLines->rangeHandle(i);
+        int startBraceLevel = (i>0)?mLines->rangeHandle(i-1)->braceLevel:0;
+        mBracketIndex[0][size+i] = range->minParenthesisLevel;
+        mBracketIndex[1][size+i] = range->minBracketLevel;
+        // the unpaired right braces lowered the level from the line start
+        mBracketIndex[2][size+i] = startBraceLevel - range->rightBraces;
+    }
+    int from = (size + mBracketNodesDirtyFrom) / 2;
+    int to = (size + std::min(mBracketNodesDirtyTo, size-1)) / 2;
+    while (from >= 1) {
+        for (int kind=0;kind<3;kind++) {
+            QVector<int>& tree = mBracketIndex[kind];
+            for (int node=from;node<=to;node++)
+                tree[node] = std::min(tree[node*2], tree[node*2+1]);
         }
+        from /= 2;
+        to /= 2;
     }
-    return result;
+    mBracketLeavesDirtyFrom = INT_MAX;
+    mBracketLeavesDirtyTo = -1;
+    mBracketNodesDirtyFrom = INT_MAX;
+    mBracketNodesDirtyTo = -1;
+    return true;
+}
+
+int SynEdit::lineStartBracketLevel(int kind, int line)
+{
+    if (line == 0)
+        return 0;
+    return rangeBracketLevel(*mLines->rangeHandle(line-1), kind);
+}
+
+/*
+ * Finds the left bracket (of kind 0:'(', 1:'[', 2:'{') that is still open before
+ * the char pos (0-based) of the line. Only the line itself and the line of the
+ * matching bracket are tokenized: it's the last line before whose lowest level
+ * is below the level at pos.
+ * If atBracket is true, the char at pos must be a right bracket token.
+ * Returns false if the bracket index can't tell (pos is not a bracket token, the
+ * lines are not scanned yet, or the levels are not consistent), result is {0,0}
+ * if there's no such bracket.
+ */
+bool SynEdit::findOpenBracket(int kind, int line, int pos, bool atBracket, BufferCoord &result)
+{
+    const QString openChars("([{");
+    const QString closeChars(")]}");
+    if (line > mLines->firstUnscannedLine())
+        return false;
+    QString s = mLines->getString(line);
+    int level = lineStartBracketLevel(kind, line);
+    QVector<int> opened; // left brackets in the line not closed before pos
+    bool bracketAtPos = false;
+    foreach (const SynEditLineToken& token, lineTokens(line)->tokens) {
+        if (token.pos >= pos) {
+            // the bracket may be in a comment or a string
+            bracketAtPos = (token.pos == pos
+                            && token.type == SynHighlighterTokenType::Symbol
+                            && token.length == 1);
+            break;
+        }
+        if (token.type != SynHighlighterTokenType::Symbol || token.length != 1)
+            continue;
+        if (s[token.pos] == openChars[kind]) {
+            opened.append(token.pos);
+            level++;
+        } else if (s[token.pos] == closeChars[kind]) {
+            if (!opened.isEmpty())
+                opened.removeLast();
+            level--;
+        }
+    }
+    if (atBracket && !bracketAtPos)
+        return false;
+    if (!opened.isEmpty()) {
+        result = BufferCoord{opened.back()+1, line+1};
+        return true;
+    }
+    int matchLine = findLastLineBelow(mBracketIndex[kind], 1, 0, mBracketIndexSize, line, level);
+    if (matchLine < 0) {
+        result = BufferCoord{0,0};
+        return true;
+    }
+    // the matching bracket is the last one in the line raising the level to the level at pos
+    int target = level;
+    int found = -1;
+    s = mLines->getString(matchLine);
+    level = lineStartBracketLevel(kind, matchLine);
+    foreach (const SynEditLineToken& token, lineTokens(matchLine)->tokens) {
+        if (token.type != SynHighlighterTokenType::Symbol || token.length != 1)
+            continue;
+        if (s[token.pos] == openChars[kind]) {
+            level++;
+            if (level == target)
+                found = token.pos;
+        } else if (s[token.pos] == closeChars[kind]) {
+            level--;
+            if (level < target)
+                found = -1;
+        }
+    }
+    if (found < 0)
+        return false;
+    result = BufferCoord{found+1, matchLine+1};
+    return true;
+}
+
+/*
+ * Finds the right bracket (of kind 0:')', 1:']', 2:'}') closing the left bracket at
+ * the char pos (0-based) of the line. It's in the line itself, or in the first line
+ * after whose lowest level is below the level after the left bracket.
+ * Returns false if the bracket index can't tell (it may be in the lines not scanned yet),
+ * result is {0,0} if there's no such bracket.
+ */
+bool SynEdit::findCloseBracket(int kind, int line, int pos, BufferCoord &result)
+{
+    const QString openChars("([{");
+    const QString closeChars(")]}");
+    int firstUnscanned = mLines->firstUnscannedLine();
+    if (line >= firstUnscanned)
+        return false;
+    QString s = mLines->getString(line);
+    int level = lineStartBracketLevel(kind, line);
+    int target = INT_MIN;
+    foreach (const SynEditLineToken& token, lineTokens(line)->tokens) {
+        if (token.type != SynHighlighterTokenType::Symbol || token.length != 1)
+            continue;
+        if (s[token.pos] == openChars[kind]) {
+            level++;
+            if (token.pos == pos)
+                target = level - 1;
+        } else if (s[token.pos] == closeChars[kind]) {
+            level--;
+            if (level == target) {
+                result = BufferCoord{token.pos+1, line+1};
+                return true;
+            }
+        }
+    }
+    // pos is not a left bracket token
+    if (target == INT_MIN)
+        return false;
+    int matchLine = findFirstLineBelow(mBracketIndex[kind], 1, 0, mBracketIndexSize,
+                                       line, firstUnscanned, target+1);
+    if (matchLine < 0) {
+        if (firstUnscanned < mLines->count())
+            return false;
+        result = BufferCoord{0,0};
+        return true;
+    }
+    s = mLines->getString(matchLine);
+    level = lineStartBracketLevel(kind, matchLine);
+    foreach (const SynEditLineToken& token, lineTokens(matchLine)->tokens) {
+        if (token.type != SynHighlighterTokenType::Symbol || token.length != 1)
+            continue;
+        if (s[token.pos] == openChars[kind]) {
+            level++;
+        } else if (s[token.pos] == closeChars[kind]) {
+            level--;
+            if (level == target) {
+                result = BufferCoord{token.pos+1, matchLine+1};
+                return true;
+            }
+        }
+    }
+    return false;
 }
 
 void SynEdit::setDefaultKeystrokes()
@@ -1194,6 +1546,9 @@ BufferCoord SynEdit::getPreviousLeftBrace(int x, int y)
     QString Line = mLines->getString(PosY - 1);
     if ((PosX > Line.length()) || (PosX<1))
         PosX = Line.length();
+    if (y <= mLines->count() && ensureBracketIndex()
+            && findOpenBracket(2, y-1, std::max(x-1,0), false, p))
+        return p;
     int numBrackets = 1;
     while (true) {
         if (Line.isEmpty()){
@@ -1236,10 +1591,16 @@ BufferCoord SynEdit::getPreviousLeftBrace(int x, int y)
 
 int SynEdit::charColumns(QChar ch) const
 {
-    if (ch == ' ')
-        return 1;
+    ushort u = ch.unicode();
+    if (u < 128)
+        return mAsciiCharColumns[u];
+    auto it = mCharColumnsCache.constFind(u);
+    if (it != mCharColumnsCache.constEnd())
+        return it.value();
     //return std::ceil((int)(fontMetrics().horizontalAdvance(ch) * dpiFactor()) / (double)mCharWidth);
-    return std::ceil((int)(fontMetrics().horizontalAdvance(ch)) / (double)mCharWidth);
+    int columns = std::ceil((int)(fontMetrics().horizontalAdvance(ch)) / (double)mCharWidth);
+    mCharColumnsCache.insert(u,columns);
+    return columns;
 }
 
 double SynEdit::dpiFactor() const
@@ -2217,6 +2578,7 @@ void SynEdit::insertLine(bool moveCaret)
         mHighlighter->setLine(leftLineText, mCaretY-1);
         mHighlighter->nextToEol();
         mLines->setRange(mCaretY-1,mHighlighter->getRangeState());
+        markBracketIndexDirty(mCaretY-1,mCaretY);
         notInComment = !mHighlighter->isLastLineCommentNotFinished(
                     mHighlighter->getRangeState().state)
                 && !mHighlighter->isLastLineStringNotFinished(
@@ -2970,6 +3332,7 @@ QRect SynEdit::clientRect()
 void SynEdit::synFontChanged()
 {
     recalcCharExtent();
+    mLines->invalidAllLineColumns();
     onSizeOrFontChanged(true);
 }
 
@@ -3018,15 +3381,40 @@ void SynEdit::ensureCursorPosVisibleEx(bool ForceToMiddle)
     }
 }
 
-void SynEdit::scrollWindow(int , int )
+/**
+ * @brief moves what's already painted by dx columns and dy rows, so only
+ * the newly exposed rows/columns need to be painted
+ */
+void SynEdit::scrollWindow(int dx, int dy)
 {
-//    int nx = horizontalScrollBar()->value()+dx;
-//    int ny = verticalScrollBar()->value()+dy;
-//    nx = std::min(std::max(horizontalScrollBar()->minimum(),nx),horizontalScrollBar()->maximum());
-//    ny = std::min(std::max(verticalScrollBar()->minimum(),ny),verticalScrollBar()->maximum());
-//    horizontalScrollBar()->setValue(nx);
-//    verticalScrollBar()->setValue(ny);
-
+    if (dx==0 && dy==0)
+        return;
+    if (mPainterLock>0)
+        return;
+    int nx = dx * mCharWidth;
+    int ny = dy * mTextHeight;
+    QRect rect;
+    if (dx == 0 && std::abs(dy) < mLinesInWindow) {
+        //the gutter scrolls with the lines
+        rect = QRect(0,0,clientWidth(),clientHeight());
+    } else if (dy == 0 && std::abs(nx) < clientWidth() - mGutterWidth - 2) {
+        rect = QRect(mGutterWidth+2,0,clientWidth()-mGutterWidth-2,clientHeight());
+    } else {
+        invalidate();
+        return;
+    }
+    if (mContentImage->size() != viewport()->size()) {
+        invalidate();
+        return;
+    }
+    //keep the cached image in step with the viewport, it's used to repaint the caret
+    QImage moved = mContentImage->copy(rect);
+    QPainter painter(mContentImage.get());
+    painter.setClipRect(rect);
+    painter.setCompositionMode(QPainter::CompositionMode_Source);
+    painter.drawImage(rect.topLeft()+QPoint(nx,ny),moved);
+    painter.end();
+    viewport()->scroll(nx,ny,rect);
 }
 
 void SynEdit::setInternalDisplayXY(const DisplayCoord &aPos)
@@ -3210,6 +3598,14 @@ void SynEdit::recalcCharExtent()
             mCharWidth = fm.horizontalAdvance("M");
     }
     mTextHeight += mExtraLineSpacing;
+
+    mCharColumnsCache.clear();
+    for (int i=0;i<128;i++) {
+        if (i == ' ' || mCharWidth<=0)
+            mAsciiCharColumns[i] = 1;
+        else
+            mAsciiCharColumns[i] = std::ceil((int)(fontMetrics().horizontalAdvance(QChar(i))) / (double)mCharWidth);
+    }
 }
 
 QString SynEdit::expandAtWideGlyphs(const QString &S)
@@ -3217,7 +3613,7 @@ QString SynEdit::expandAtWideGlyphs(const QString &S)
     QString Result(S.length()*2); // speed improvement
     int  j = 0;
     for (int i=0;i<S.length();i++) {
-        int CountOfAvgGlyphs = ceil(fontMetrics().horizontalAdvance(S[i])/(double)mCharWidth);
+        int CountOfAvgGlyphs = charColumns(S[i]);
         if (j+CountOfAvgGlyphs>=Result.length())
             Result.resize(Result.length()+128);
         // insert CountOfAvgGlyphs filling chars
@@ -3240,10 +3636,25 @@ void SynEdit::updateModifiedStatus()
 
 int SynEdit::scanFrom(int Index, int canStopIndex)
 {
-    SynRangeState iRange;
+    PSynRangeState iRange;
     int Result = std::max(0,Index);
     if (Result >= mLines->count())
         return Result;
+    //mapped files don't keep ranges, lines are highlighted when painted
+    if (mLines->mapped())
+        return Result;
+    //ranges after the first unscanned line are not valid anyway, they'll be scanned later
+    int firstUnscanned = mLines->firstUnscannedLine();
+    if (Result >= firstUnscanned)
+        return Result;
+    int lastVisible = lastVisibleLineIndex();
+    //lines after the ones whose ranges are changed are tokenized differently
+    int rangeChangedFrom = INT_MAX;
+    int rangeChangedTo = -1;
+    auto action = finally([&,this]{
+        if (rangeChangedFrom <= rangeChangedTo)
+            invalidateLineMatches(rangeChangedFrom+1, rangeChangedTo+1);
+    });
 
     if (Result == 0) {
         mHighlighter->resetState();
@@ -3252,36 +3663,254 @@ int SynEdit::scanFrom(int Index, int canStopIndex)
     }
     do {
         mHighlighter->setLine(mLines->getString(Result), Result);
-        mHighlighter->nextToEol();
-        iRange = mHighlighter->getRangeState();
+        if (Result <= lastVisible) {
+            //keep the tokens of the lines in the window for painting
+            PSynEditLineTokens tokens = std::make_shared<SynEditLineTokens>();
+            if (Result > 0)
+                tokens->startRange = mLines->rangeHandle(Result-1);
+            readLineTokens(*tokens);
+            mLines->setLineTokens(Result,tokens);
+        } else
+            mHighlighter->nextToEol();
+        iRange = mLines->internRange(mHighlighter->getRangeState());
+        PSynRangeState oldRange = mLines->rangeHandle(Result);
         if (Result > canStopIndex){
-            if (mLines->ranges(Result).state == iRange.state
-                    && mLines->ranges(Result).braceLevel == iRange.braceLevel
-                    && mLines->ranges(Result).parenthesisLevel == iRange.parenthesisLevel
-                    && mLines->ranges(Result).bracketLevel == iRange.bracketLevel
-                    ) {
-                if (mUseCodeFolding)
-                    rescanFolds();
+            if (oldRange == iRange) {
+                updateFolds();
                 return Result;// avoid the final Decrement
             }
         }
+        if (oldRange->leftBraces != iRange->leftBraces
+                || oldRange->rightBraces != iRange->rightBraces)
+            markFoldsDirty(Result,Result);
         mLines->setRange(Result,iRange);
+        markBracketIndexDirty(Result,Result+1);
+        rangeChangedFrom = std::min(rangeChangedFrom, Result);
+        rangeChangedTo = Result;
         Result ++ ;
-    } while (Result < mLines->count());
+        //don't scan (maybe the rest of the file) below the window now,
+        //leave it to the idle scan
+        if (Result > lastVisible
+                && (Result > canStopIndex || Result - Index >= 100)
+                && Result < mLines->count()) {
+            mLines->setFirstUnscannedLine(Result);
+            scheduleRangeScan();
+            return Result-1;
+        }
+    } while (Result < mLines->count() && Result < firstUnscanned);
     Result--;
-    if (mUseCodeFolding)
-        rescanFolds();
+    updateFolds();
     return Result;
 }
 
+void SynEdit::scanRangesTo(int line)
+{
+    int first = mLines->firstUnscannedLine();
+    if (line < first)
+        return;
+    if (!mHighlighter || mLines->mapped() || first >= mLines->count()) {
+        mLines->setFirstUnscannedLine(INT_MAX);
+        return;
+    }
+    line = std::min(line, mLines->count()-1);
+    if (first == 0) {
+        mHighlighter->resetState();
+    } else {
+        mHighlighter->setState(mLines->ranges(first-1));
+    }
+    for (int i=first;i<=line;i++) {
+        mHighlighter->setLine(mLines->getString(i), i);
+        mHighlighter->nextToEol();
+        mLines->setRange(i, mHighlighter->getRangeState());
+    }
+    markBracketIndexDirty(first, line+1);
+    invalidateLineMatches(first+1, line+1);
+    if (line+1 < mLines->count())
+        mLines->setFirstUnscannedLine(line+1);
+    else
+        mLines->setFirstUnscannedLine(INT_MAX);
+}
+
+PSynEditLineTokens SynEdit::lineTokens(int line)
+{
+    PSynEditLineTokens tokens = mLines->lineTokens(line);
+    if (!tokens) {
+        tokens = tokenizeLine(mLines->getString(line), line);
+        mLines->setLineTokens(line, tokens);
+    }
+    return tokens;
+}
+
+PSynEditLineTokens SynEdit::tokenizeLine(const QString &lineText, int line)
+{
+    PSynEditLineTokens tokens = std::make_shared<SynEditLineTokens>();
+    if (line == 0) {
+        mHighlighter->resetState();
+    } else {
+        tokens->startRange = mLines->rangeHandle(line-1);
+        mHighlighter->setState(*(tokens->startRange));
+    }
+    mHighlighter->setLine(lineText, line);
+    readLineTokens(*tokens);
+    return tokens;
+}
+
+void SynEdit::readLineTokens(SynEditLineTokens &lineTokens)
+{
+    while (!mHighlighter->eol()) {
+        QString token = mHighlighter->getToken();
+        // Work-around buggy highlighters which return empty tokens.
+        if (token.isEmpty())  {
+            mHighlighter->next();
+            if (mHighlighter->eol())
+                break;
+            token = mHighlighter->getToken();
+            if (token.isEmpty()) {
+                throw BaseError(tr("The highlighter seems to be in an infinite loop"));
+            }
+        }
+        SynEditLineToken lineToken;
+        lineToken.pos = mHighlighter->getTokenPos();
+        lineToken.length = token.length();
+        lineToken.attr = mHighlighter->getTokenAttribute();
+        lineToken.kind = mHighlighter->getTokenKind();
+        lineToken.type = mHighlighter->getTokenType();
+        lineToken.finished = mHighlighter->getTokenFinished();
+        lineToken.level = 0;
+        if (token == "[" || token == "(" || token == "{"
+                || token == "]" || token == ")" || token == "}") {
+            SynRangeState rangeState = mHighlighter->getRangeState();
+            lineToken.level = rangeState.bracketLevel
+                    +rangeState.braceLevel
+                    +rangeState.parenthesisLevel;
+        }
+        lineTokens.tokens.append(lineToken);
+        mHighlighter->next();
+    }
+}
+
+int SynEdit::lastVisibleLineIndex()
+{
+    return std::max(0,rowToLine(mTopLine + mLinesInWindow)-1);
+}
+
+void SynEdit::scheduleRangeScan()
+{
+    if (!mRangeScanTimer->isActive())
+        mRangeScanTimer->start();
+}
+
+void SynEdit::onRangeScanTimeout()
+{
+    QElapsedTimer timer;
+    timer.start();
+    //scan in small slices, so the gui can handle events between them
+    while (mLines->firstUnscannedLine() < mLines->count()
+           && timer.elapsed() < 20) {
+        scanRangesTo(mLines->firstUnscannedLine() + 500);
+    }
+    if (mLines->firstUnscannedLine() < mLines->count()) {
+        scheduleRangeScan();
+    } else {
+        rescanFolds();
+    }
+    if (mMatchSearchEngine && mMatchScanLine < mLines->count()
+            && !mMatchScanTimer->isActive())
+        mMatchScanTimer->start();
+}
+
+void SynEdit::scheduleMatchScan(int fromLine)
+{
+    if (!mMatchSearchEngine)
+        return;
+    if (fromLine < mMatchScanLine) {
+        mMatchScanLine = std::max(0,fromLine);
+        mMatchLines.erase(std::lower_bound(mMatchLines.begin(),mMatchLines.end(),mMatchScanLine),
+                          mMatchLines.end());
+    }
+    if (!mMatchScanTimer->isActive())
+        mMatchScanTimer->start();
+}
+
+void SynEdit::rescanMatchLines(int index, int count)
+{
+    if (!mMatchSearchEngine || index >= mMatchScanLine)
+        return;
+    //the idle scan is faster for a lot of lines
+    if (count > 500) {
+        scheduleMatchScan(index);
+        return;
+    }
+    for (int i=index;i<index+count && i<mMatchScanLine;i++) {
+        bool found = !lineMatches(i).isEmpty();
+        QVector<int>::iterator it = std::lower_bound(mMatchLines.begin(),mMatchLines.end(),i);
+        bool listed = (it!=mMatchLines.end() && *it == i);
+        if (found && !listed)
+            mMatchLines.insert(it,i);
+        else if (!found && listed)
+            mMatchLines.erase(it);
+    }
+    updateMatchMarks();
+}
+
+void SynEdit::invalidateLineMatches(int fromLine, int toLine)
+{
+    //only the matches filtered by the tokens depend on the ranges of the lines before
+    if (!mMatchSearchEngine || mMatchTokenTypes.isEmpty())
+        return;
+    toLine = std::min(toLine, mLines->count()-1);
+    if (fromLine > toLine)
+        return;
+    for (int i=fromLine;i<=toLine;i++)
+        mLines->setLineMatches(i, -1, QVector<SynEditLineMatch>());
+    rescanMatchLines(fromLine, toLine-fromLine+1);
+    invalidateLines(fromLine+1, toLine+1);
+}
+
+void SynEdit::updateMatchMarks()
+{
+    QColor color = mMatchBackground;
+    if (!color.isValid())
+        color = mSelectedBackground;
+    mVerticalScrollBar->setMarks(mMatchLines,mLines->count(),color);
+}
+
+void SynEdit::onMatchScanTimeout()
+{
+    if (!mMatchSearchEngine)
+        return;
+    QElapsedTimer timer;
+    timer.start();
+    //filtering the matches by tokens needs the ranges, so don't go past the range scan,
+    //it restarts this scan when it goes on
+    int scanEnd = mLines->count();
+    if (mHighlighter && !mMatchTokenTypes.isEmpty())
+        scanEnd = std::min(scanEnd, mLines->firstUnscannedLine());
+    //scan in small slices, so the gui can handle events between them
+    while (mMatchScanLine < scanEnd
+           && timer.elapsed() < 20) {
+        int last = std::min(mMatchScanLine + 500, scanEnd);
+        for (;mMatchScanLine<last;mMatchScanLine++) {
+            if (!lineMatches(mMatchScanLine).isEmpty())
+                mMatchLines.append(mMatchScanLine);
+        }
+    }
+    if (mMatchScanLine < scanEnd)
+        mMatchScanTimer->start();
+    else if (mMatchScanLine >= mLines->count())
+        updateMatchMarks();
+}
+
 void SynEdit::rescanRange(int line)
 {
-    if (!mHighlighter)
+    if (!mHighlighter || mLines->mapped())
         return;
     line--;
     line = std::max(0,line);
     if (line >= mLines->count())
         return;
+    if (line >= mLines->firstUnscannedLine())
+        return;
 
     if (line == 0) {
         mHighlighter->resetState();
@@ -3290,19 +3919,24 @@ void SynEdit::rescanRange(int line)
     }
     mHighlighter->setLine(mLines->getString(line), line);
     mHighlighter->nextToEol();
-    SynRangeState iRange = mHighlighter->getRangeState();
+    PSynRangeState iRange = mLines->internRange(mHighlighter->getRangeState());
+    PSynRangeState oldRange = mLines->rangeHandle(line);
+    if (oldRange->leftBraces != iRange->leftBraces
+            || oldRange->rightBraces != iRange->rightBraces)
+        markFoldsDirty(line,line);
     mLines->setRange(line,iRange);
+    markBracketIndexDirty(line,line+1);
+    invalidateLineMatches(line+1, line+1);
 }
 
 void SynEdit::rescanRanges()
 {
-    if (mHighlighter && !mLines->empty()) {
-        mHighlighter->resetState();
-        for (int i =0;i<mLines->count();i++) {
-            mHighlighter->setLine(mLines->getString(i), i);
-            mHighlighter->nextToEol();
-            mLines->setRange(i, mHighlighter->getRangeState());
-        }
+    if (mHighlighter && !mLines->empty() && !mLines->mapped()) {
+        //only the lines in the window are scanned now, the rest in idle time
+        mLines->setFirstUnscannedLine(0);
+        scanRangesTo(lastVisibleLineIndex());
+        if (mLines->firstUnscannedLine() < mLines->count())
+            scheduleRangeScan();
     }
     if (mUseCodeFolding)
         rescanFolds();
@@ -3312,6 +3946,7 @@ void SynEdit::uncollapse(PSynEditFoldRange FoldRange)
 {
     FoldRange->linesCollapsed = 0;
     FoldRange->collapsed = false;
+    invalidateFoldIndex();
 
     // Redraw the collapsed line
     invalidateLines(FoldRange->fromLine, INT_MAX);
@@ -3324,6 +3959,7 @@ void SynEdit::collapse(PSynEditFoldRange FoldRange)
 {
     FoldRange->linesCollapsed = FoldRange->toLine - FoldRange->fromLine;
     FoldRange->collapsed = true;
+    invalidateFoldIndex();
 
     // Extract caret from fold
     if ((mCaretY > FoldRange->fromLine) && (mCaretY <= FoldRange->toLine)) {
@@ -3340,6 +3976,7 @@ void SynEdit::collapse(PSynEditFoldRange FoldRange)
 
 void SynEdit::foldOnListInserted(int Line, int Count)
 {
+    invalidateFoldIndex();
     // Delete collapsed inside selection
     for (int i = mAllFoldRanges.count()-1;i>=0;i--) {
         PSynEditFoldRange range = mAllFoldRanges[i];
@@ -3348,12 +3985,19 @@ void SynEdit::foldOnListInserted(int Line, int Count)
                 uncollapse(range);
             else if (range->fromLine >= Line) // insertion of count lines above FromLine
                 range->move(Count);
+        } else {
+            // keep the other folds in place, so only the lines with changed braces need rescan
+            if (range->fromLine >= Line)
+                range->move(Count);
+            else if (range->toLine != range->fromLine && range->toLine >= Line)
+                range->toLine += Count;
         }
     }
 }
 
 void SynEdit::foldOnListDeleted(int Line, int Count)
 {
+    invalidateFoldIndex();
     // Delete collapsed inside selection
     for (int i = mAllFoldRanges.count()-1;i>=0;i--) {
         PSynEditFoldRange range = mAllFoldRanges[i];
@@ -3364,6 +4008,23 @@ void SynEdit::foldOnListDeleted(int Line, int Count)
                 mAllFoldRanges.remove(i);
             else if (range->fromLine >= Line + Count) // Move after affected area
                 range->move(-Count);
+        } else {
+            bool unclosed = (range->toLine == range->fromLine);
+            bool affected = (range->fromLine >= Line && range->fromLine < Line + Count)
+                    || (!unclosed && range->toLine >= Line && range->toLine < Line + Count);
+            if (range->fromLine >= Line + Count)
+                range->fromLine -= Count;
+            else if (range->fromLine >= Line)
+                range->fromLine = Line;
+            if (unclosed)
+                range->toLine = range->fromLine;
+            else if (range->toLine >= Line + Count)
+                range->toLine -= Count;
+            else if (range->toLine >= Line)
+                range->toLine = Line;
+            // a deleted line started or ended this fold
+            if (affected)
+                markFoldsDirty(Line-1,Line-1);
         }
     }
 
@@ -3372,18 +4033,163 @@ void SynEdit::foldOnListDeleted(int Line, int Count)
 void SynEdit::foldOnListCleared()
 {
     mAllFoldRanges.clear();
+    invalidateFoldIndex();
 }
 
 void SynEdit::rescanFolds()
 {
     if (!mUseCodeFolding)
         return;
-    rescanForFoldRanges();
+    //folds need the ranges of all lines, they are rescanned when the idle scan is done
+    if (mLines->firstUnscannedLine() < mLines->count())
+        return;
+    mFoldsDirtyFrom = INT_MAX;
+    mFoldsDirtyTo = -1;
+    if (!rescanBraceFoldRanges(0, mLines->count()-1))
+        rescanForFoldRanges();
+    invalidateFoldIndex();
+    invalidateGutter();
+}
+
+void SynEdit::markFoldsDirty(int fromLine, int toLine)
+{
+    mFoldsDirtyFrom = std::min(mFoldsDirtyFrom, fromLine);
+    mFoldsDirtyTo = std::max(mFoldsDirtyTo, toLine);
+}
+
+void SynEdit::updateFolds()
+{
+    if (!mUseCodeFolding || mFoldsDirtyFrom == INT_MAX)
+        return;
+    if (mLines->firstUnscannedLine() < mLines->count())
+        return;
+    int fromLine = mFoldsDirtyFrom;
+    int toLine = mFoldsDirtyTo;
+    mFoldsDirtyFrom = INT_MAX;
+    mFoldsDirtyTo = -1;
+    if (!rescanBraceFoldRanges(fromLine, toLine))
+        rescanForFoldRanges();
+    invalidateFoldIndex();
     invalidateGutter();
 }
 
 static void null_deleter(SynEditFoldRanges *) {}
 
+/*
+ * Rebuilds the brace folds from the leftBraces/rightBraces of the lines,
+ * starting at fromLine (0-based), given that only the braces of lines
+ * fromLine..toLine have changed.
+ * Folds before fromLine are kept, the ones still open at fromLine are reopened,
+ * and the scan stops as soon as it's past toLine with no fold open in both
+ * the old and new folds, keeping the old folds after that point.
+ * Collapsed folds are kept and moved to their new parent.
+ * Returns false if the folds can't be updated this way.
+ */
+bool SynEdit::rescanBraceFoldRanges(int fromLine, int toLine)
+{
+    if (!mHighlighter)
+        return false;
+    if (mCodeFolding.foldRegions.count()!=1)
+        return false;
+    PSynEditFoldRegion region = mCodeFolding.foldRegions.get(0);
+    if (region->openSymbol != '{' || region->closeSymbol != '}')
+        return false;
+    int startLine = fromLine + 1; // folds use 1-based lines
+    QVector<PSynEditFoldRange> keptFolds;
+    QVector<PSynEditFoldRange> openFolds;
+    QVector<PSynEditFoldRange> oldFolds;
+    QMap<int,PSynEditFoldRange> collapsedFolds;
+    int oldOpenUntil = 0;
+    for (int i=0;i<mAllFoldRanges.count();i++) {
+        PSynEditFoldRange range = mAllFoldRanges[i];
+        bool hidden = range->collapsed || range->parentCollapsed();
+        bool unclosed = (range->toLine == range->fromLine);
+        if (range->fromLine < startLine) {
+            if (unclosed || range->toLine >= startLine) {
+                // the changed lines are inside a collapsed fold
+                if (hidden)
+                    return false;
+                openFolds.append(range);
+                oldOpenUntil = std::max(oldOpenUntil, unclosed?INT_MAX:range->toLine);
+            }
+            keptFolds.append(range);
+        } else if (hidden) {
+            keptFolds.append(range);
+            if (range->collapsed && !range->parentCollapsed())
+                collapsedFolds.insert(range->fromLine,range);
+        } else {
+            oldFolds.append(range);
+        }
+    }
+    foreach (const PSynEditFoldRange& range, openFolds) {
+        range->toLine = range->fromLine;
+    }
+
+    PSynEditFoldRanges allFolds(&mAllFoldRanges, null_deleter);
+    QVector<PSynEditFoldRange> newFolds;
+    int oldIndex = 0;
+    int line = fromLine;
+    while (line < mLines->count()) {
+        if (line > toLine && openFolds.isEmpty() && oldOpenUntil < line + 1)
+            break;
+        PSynEditFoldRange collapsedFold = collapsedFolds.value(line + 1);
+        if (collapsedFold) {
+            PSynEditFoldRange parent = openFolds.isEmpty()?PSynEditFoldRange():openFolds.last();
+            if (collapsedFold->parent)
+                collapsedFold->parent->subFoldRanges->remove(collapsedFold);
+            collapsedFold->parent = parent;
+            if (parent)
+                parent->subFoldRanges->add(collapsedFold);
+            line = collapsedFold->toLine;
+            continue;
+        }
+        while (oldIndex < oldFolds.count() && oldFolds[oldIndex]->fromLine <= line + 1) {
+            PSynEditFoldRange range = oldFolds[oldIndex];
+            oldOpenUntil = std::max(oldOpenUntil,
+                                    (range->toLine == range->fromLine)?INT_MAX:range->toLine);
+            oldIndex++;
+        }
+        int rightBraces = mLines->rightBraces(line);
+        for (int i=0; i<rightBraces && !openFolds.isEmpty(); i++) {
+            openFolds.last()->toLine = line + 1;
+            openFolds.removeLast();
+        }
+        int leftBraces = mLines->leftBraces(line);
+        for (int i=0; i<leftBraces; i++) {
+            PSynEditFoldRange parent = openFolds.isEmpty()?PSynEditFoldRange():openFolds.last();
+            PSynEditFoldRange range = std::make_shared<SynEditFoldRange>(
+                        parent, allFolds, line + 1, region, line + 1);
+            if (parent)
+                parent->subFoldRanges->add(range);
+            newFolds.append(range);
+            openFolds.append(range);
+        }
+        line++;
+    }
+
+    // old folds the scan has passed are replaced by the new ones
+    QSet<SynEditFoldRange*> removedFolds;
+    for (int i=0;i<oldIndex;i++) {
+        removedFolds.insert(oldFolds[i].get());
+    }
+    for (int i=0;i<oldIndex;i++) {
+        PSynEditFoldRange range = oldFolds[i];
+        if (range->parent && !removedFolds.contains(range->parent.get()))
+            range->parent->subFoldRanges->remove(range);
+    }
+    keptFolds.append(newFolds);
+    keptFolds.append(oldFolds.mid(oldIndex));
+    std::stable_sort(keptFolds.begin(),keptFolds.end(),
+                     [](const PSynEditFoldRange& r1, const PSynEditFoldRange& r2) {
+        return r1->fromLine < r2->fromLine;
+    });
+    mAllFoldRanges.clear();
+    foreach (const PSynEditFoldRange& range, keptFolds) {
+        mAllFoldRanges.add(range);
+    }
+    return true;
+}
+
 void SynEdit::rescanForFoldRanges()
 {
     // Delete all uncollapsed folds
@@ -3799,9 +4605,11 @@ void SynEdit::onChanged()
 
 void SynEdit::onScrolled(int)
 {
+    int oldLeftChar = mLeftChar;
+    int oldTopLine = mTopLine;
     mLeftChar = horizontalScrollBar()->value();
     mTopLine = verticalScrollBar()->value();
-    invalidate();
+    scrollWindow(oldLeftChar - mLeftChar, oldTopLine - mTopLine);
 }
 
 const QColor &SynEdit::backgroundColor() const
@@ -3899,6 +4707,26 @@ void SynEdit::setSelectedBackground(const QColor &newSelectedBackground)
     mSelectedBackground = newSelectedBackground;
 }
 
+const QColor &SynEdit::matchForeground() const
+{
+    return mMatchForeground;
+}
+
+void SynEdit::setMatchForeground(const QColor &newMatchForeground)
+{
+    mMatchForeground = newMatchForeground;
+}
+
+const QColor &SynEdit::matchBackground() const
+{
+    return mMatchBackground;
+}
+
+void SynEdit::setMatchBackground(const QColor &newMatchBackground)
+{
+    mMatchBackground = newMatchBackground;
+}
+
 const QColor &SynEdit::selectedForeground() const
 {
     return mSelectedForeground;
@@ -4009,6 +4837,7 @@ void SynEdit::setOptions(const SynEditorOptions &Value)
         //bool bUpdateScroll = (Options * ScrollOptions)<>(Value * ScrollOptions);
         bool bUpdateScroll = true;
         mOptions = Value;
+        mUndoList->setGroupUndo(mOptions.testFlag(eoGroupUndo));
 
         // constrain caret position to MaxScrollWidth if eoScrollPastEol is enabled
         internalSetCaretXY(caretXY());
@@ -4611,6 +5440,7 @@ void SynEdit::setHighlighter(const PSynHighlighter &highlighter)
 {
     PSynHighlighter oldHighlighter= mHighlighter;
     mHighlighter = highlighter;
+    mLines->clearLineTokens();
     if (oldHighlighter && mHighlighter &&
             oldHighlighter->language() == highlighter->language()) {
     } else {
@@ -4849,7 +5679,6 @@ int SynEdit::searchReplace(const QString &sSearch, const QString &sReplace, SynS
     // option if nothing is selected
     bool bBackward = sOptions.testFlag(ssoBackwards);
     bool bFromCursor = !sOptions.testFlag(ssoEntireScope);
-    BufferCoord ptCurrent;
     BufferCoord ptStart;
     BufferCoord ptEnd;
     if (!selAvail())
@@ -4866,12 +5695,6 @@ int SynEdit::searchReplace(const QString &sSearch, const QString &sReplace, SynS
             if (ptStart.Char > ptEnd.Char)
                 std::swap(ptStart.Char,ptEnd.Char);
         }
-        // ignore the cursor position when searching in the selection
-        if (bBackward) {
-            ptCurrent = ptEnd;
-        } else {
-            ptCurrent = ptStart;
-        }
     } else {
         ptStart.Char = 1;
         ptStart.Line = 1;
@@ -4883,10 +5706,6 @@ int SynEdit::searchReplace(const QString &sSearch, const QString &sReplace, SynS
             else
                 ptStart = caretXY();
         }
-        if (bBackward)
-            ptCurrent = ptEnd;
-        else
-            ptCurrent = ptStart;
     }
     // initialize the search engine
     searchEngine->setOptions(sOptions);
@@ -4902,105 +5721,318 @@ int SynEdit::searchReplace(const QString &sSearch, const QString &sReplace, SynS
             }
             doOnPaintTransient(SynTransientType::ttAfter);
         });
-        int i;
+        // Search the range in chunks of lines, so looking for the next match doesn't go
+        // through the rest of the file. Backward searches still go through the range at once:
+        // where a match starts depends on the text before it.
+        int chunkSize = bBackward ? INT_MAX : SEARCH_CHUNK_LINES;
+        int chunkFrom = ptStart.Line;
+        bool firstChunk = true;
+        // Replacements move the matches after them: lines by lineDelta,
+        // and the rest of the line where the last replaced text ended by charDelta
+        int lineDelta = 0;
+        int charDeltaLine = -1;
+        int charDelta = 0;
+        // Is the search result entirely in the search range?
+        auto isInValidSearchRange = [&](const SynSearchMatch& match) {
+            int first = match.start.Char;
+            int last = match.end.Char;
+            if ((mActiveSelectionMode == SynSelectionMode::smNormal)
+                    || !sOptions.testFlag(ssoSelectedOnly)) {
+                if ((firstChunk && (match.start.Line == ptStart.Line) && (first < ptStart.Char)) ||
+                        ((match.end.Line == ptEnd.Line) && (last > ptEnd.Char)))
+                    return false;
+            } else if (mActiveSelectionMode == SynSelectionMode::smColumn) {
+                // solves bug in search/replace when smColumn mode active and no selection
+                return ((match.start.Line == match.end.Line)
+                        && (first >= ptStart.Char) && (last <= ptEnd.Char))
+                        || (ptEnd.Char - ptStart.Char < 1);
+            }
+            return true;
+        };
+        // the position of the match in the text after the replacements done so far
+        auto currentMatch = [&](const SynSearchMatch& match) {
+            SynSearchMatch current = match;
+            if (current.start.Line == charDeltaLine)
+                current.start.Char += charDelta;
+            if (current.end.Line == charDeltaLine)
+                current.end.Char += charDelta;
+            current.start.Line += lineDelta;
+            current.end.Line += lineDelta;
+            return current;
+        };
         // If it's a search only we can leave the procedure now.
         SynSearchAction searchAction = SynSearchAction::Exit;
-        while ((ptCurrent.Line >= ptStart.Line) && (ptCurrent.Line <= ptEnd.Line)) {
-            int nInLine = searchEngine->findAll(mLines->getString(ptCurrent.Line - 1));
-            int iResultOffset = 0;
-            if (bBackward)
-                i = searchEngine->resultCount()-1;
-            else
-                i = 0;
-            // Operate on all results in this line.
-            while (nInLine > 0) {
-                // An occurrence may have been replaced with a text of different length
-                int nFound = searchEngine->result(i) + 1 + iResultOffset;
-                int nSearchLen = searchEngine->length(i);
-                int nReplaceLen = 0;
-                if (bBackward)
-                    i--;
-                else
-                    i++;
-                nInLine--;
-                // Is the search result entirely in the search range?
-                bool isInValidSearchRange = true;
-                int first = nFound;
-                int last = nFound + nSearchLen;
-                if ((mActiveSelectionMode == SynSelectionMode::smNormal)
-                        || !sOptions.testFlag(ssoSelectedOnly)) {
-                    if (((ptCurrent.Line == ptStart.Line) && (first < ptStart.Char)) ||
-                            ((ptCurrent.Line == ptEnd.Line) && (last > ptEnd.Char)))
-                        isInValidSearchRange = false;
-                } else if (mActiveSelectionMode == SynSelectionMode::smColumn) {
-                    // solves bug in search/replace when smColumn mode active and no selection
-                    isInValidSearchRange = ((first >= ptStart.Char) && (last <= ptEnd.Char))
-                            || (ptEnd.Char - ptStart.Char < 1);
+        while (chunkFrom <= ptEnd.Line) {
+            int chunkTo = (chunkSize > ptEnd.Line - chunkFrom) ? ptEnd.Line : chunkFrom + chunkSize - 1;
+            QVector<SynSearchMatch> matches = findAllMatches(searchEngine, chunkFrom, chunkTo);
+            int count = matches.count();
+            int nextFrom = chunkTo + 1;
+            if (chunkTo < ptEnd.Line) {
+                // matches reaching the last line of the chunk may go on after it,
+                // they are searched again in the next chunk
+                nextFrom = chunkTo;
+                while (count>0 && matches[count-1].end.Line >= nextFrom) {
+                    nextFrom = std::min(nextFrom, matches[count-1].start.Line);
+                    count--;
                 }
-                if (!isInValidSearchRange)
+                if (nextFrom <= chunkFrom) {
+                    chunkSize *= 2;
+                    continue;
+                }
+            }
+            lineDelta = 0;
+            charDeltaLine = -1;
+            charDelta = 0;
+            for (int i=0;i<count;i++) {
+                const SynSearchMatch& match = bBackward ? matches[count-1-i] : matches[i];
+                if (!isInValidSearchRange(match))
                     continue;
                 result++;
+                SynSearchMatch found = currentMatch(match);
+                BufferCoord foundStart = found.start;
+                BufferCoord foundEnd = found.end;
                 // Select the text, so the user can see it in the OnReplaceText event
                 // handler or as the search result.
-                ptCurrent.Char = nFound;
-                setBlockBegin(ptCurrent);
+                setBlockBegin(foundStart);
 
                 //Be sure to use the Ex version of CursorPos so that it appears in the middle if necessary
-                setCaretXYEx(false, BufferCoord{1, ptCurrent.Line});
+                setCaretXYEx(false, BufferCoord{1, foundStart.Line});
                 ensureCursorPosVisibleEx(true);
-                ptCurrent.Char += nSearchLen;
-                setBlockEnd(ptCurrent);
-                //internalSetCaretXY(ptCurrent);
+                setBlockEnd(foundEnd);
                 if (bBackward)
                     internalSetCaretXY(blockBegin());
                 else
-                    internalSetCaretXY(ptCurrent);
+                    internalSetCaretXY(foundEnd);
 
                 QString replaceText = searchEngine->replace(selText(), sReplace);
                 if (matchedCallback && !dobatchReplace) {
-                    searchAction = matchedCallback(sSearch,replaceText,ptCurrent.Line,
-                                    nFound,nSearchLen);
+                    searchAction = matchedCallback(sSearch,replaceText,foundStart.Line,
+                                    foundStart.Char,match.length);
                 }
                 if (searchAction==SynSearchAction::Exit) {
                     return result;
                 } else if (searchAction == SynSearchAction::Skip) {
                     continue;
-                } else if (searchAction == SynSearchAction::Replace
-                           || searchAction == SynSearchAction::ReplaceAll) {
-                    if (!dobatchReplace &&
-                            (searchAction == SynSearchAction::ReplaceAll) ){
-                        incPaintLock();
-                        mUndoList->BeginBlock();
-                        dobatchReplace = true;
+                } else if (searchAction == SynSearchAction::ReplaceAll) {
+                    // replace this and all the remaining matches at once
+                    incPaintLock();
+                    mUndoList->BeginBlock();
+                    dobatchReplace = true;
+                    QVector<SynSearchMatch> remaining;
+                    remaining.append(found);
+                    for (int j=i+1;j<count;j++) {
+                        const SynSearchMatch& m = bBackward ? matches[count-1-j] : matches[j];
+                        if (isInValidSearchRange(m))
+                            remaining.append(currentMatch(m));
+                    }
+                    // and the matches after this chunk, they are in the current text
+                    ptEnd.Line += lineDelta;
+                    foreach (const SynSearchMatch& m,
+                             findAllMatches(searchEngine, nextFrom+lineDelta, ptEnd.Line)) {
+                        if (isInValidSearchRange(m))
+                            remaining.append(m);
                     }
+                    result += remaining.count() - 1;
+                    if (bBackward)
+                        std::reverse(remaining.begin(),remaining.end());
+                    replaceMatches(remaining, searchEngine, sReplace);
+                    return result;
+                } else if (searchAction == SynSearchAction::Replace) {
                     bool oldAutoIndent = mOptions.testFlag(SynEditorOption::eoAutoIndent);
                     mOptions.setFlag(SynEditorOption::eoAutoIndent,false);
                     doSetSelText(replaceText);
-                    nReplaceLen = caretX() - nFound;
-                    // fix the caret position and the remaining results
+                    // fix the remaining results
                     if (!bBackward) {
-                        internalSetCaretX(nFound + nReplaceLen);
-                        if ((nSearchLen != nReplaceLen)) {
-                            iResultOffset += nReplaceLen - nSearchLen;
-                            if ((mActiveSelectionMode != SynSelectionMode::smColumn) && (caretY() == ptEnd.Line)) {
-                                ptEnd.Char+=nReplaceLen - nSearchLen;
-                                setBlockEnd(ptEnd);
-                            }
-                        }
+                        BufferCoord newEnd = caretXY();
+                        lineDelta += newEnd.Line - foundEnd.Line;
+                        charDeltaLine = match.end.Line;
+                        charDelta = newEnd.Char - match.end.Char;
                     }
                     mOptions.setFlag(SynEditorOption::eoAutoIndent,oldAutoIndent);
                 }
             }
-            // search next / previous line
-            if (bBackward)
-                ptCurrent.Line--;
-            else
-                ptCurrent.Line++;
+            // the replacements in this chunk moved the lines after it
+            chunkFrom = nextFrom + lineDelta;
+            ptEnd.Line += lineDelta;
+            firstChunk = false;
         }
     }
     return result;
 }
 
+void SynEdit::replaceMatches(const QVector<SynSearchMatch> &matches, PSynSearchBase searchEngine,
+                             const QString &sReplace)
+{
+    if (matches.isEmpty())
+        return;
+    BufferCoord changeStart = matches.front().start;
+    BufferCoord changeEnd = matches.back().end;
+    int firstLine = changeStart.Line;
+    int lastLine = changeEnd.Line;
+    // text between two positions, with the lines joined by '\n' like the searched text
+    auto textBetween = [this](const BufferCoord& from, const BufferCoord& to) {
+        if (from.Line == to.Line)
+            return mLines->getString(from.Line-1).mid(from.Char-1, to.Char-from.Char);
+        QString text = mLines->getString(from.Line-1).mid(from.Char-1);
+        for (int line=from.Line+1;line<to.Line;line++) {
+            text.append('\n');
+            text.append(mLines->getString(line-1));
+        }
+        text.append('\n');
+        text.append(mLines->getString(to.Line-1).left(to.Char-1));
+        return text;
+    };
+    // build the new lines in one pass
+    QStringList newLines;
+    QString current = mLines->getString(firstLine-1).left(changeStart.Char-1);
+    auto appendText = [&newLines,&current](const QString& text) {
+        int start = 0;
+        int p = GetEOL(text,start);
+        current.append(text.mid(start,p-start));
+        while (p < text.length()) {
+            if (text[p] == '\r')
+                p++;
+            if (p < text.length() && text[p] == '\n')
+                p++;
+            newLines.append(current);
+            start = p;
+            p = GetEOL(text,start);
+            current = text.mid(start,p-start);
+        }
+    };
+    BufferCoord pos = changeStart;
+    for (const SynSearchMatch& match:matches) {
+        appendText(textBetween(pos, match.start));
+        appendText(searchEngine->replace(textBetween(match.start, match.end), sReplace));
+        pos = match.end;
+    }
+    BufferCoord newEnd{current.length()+1, firstLine + newLines.count()};
+    current.append(mLines->getString(lastLine-1).mid(pos.Char-1));
+    newLines.append(current);
+
+    QString oldText = textBetween(changeStart, changeEnd);
+    oldText.replace('\n', lineBreak());
+    mUndoList->BeginBlock();
+    incPaintLock();
+    mLines->beginUpdate();
+    auto action = finally([this]{
+        mLines->endUpdate();
+        decPaintLock();
+        mUndoList->EndBlock();
+    });
+    mUndoList->AddChange(
+                SynChangeReason::crDelete, changeStart, changeEnd,
+                oldText, SynSelectionMode::smNormal);
+    // put the changed lines, and insert or delete the rest
+    int oldCount = lastLine - firstLine + 1;
+    int newCount = newLines.count();
+    int common = std::min(oldCount, newCount);
+    for (int i=0;i<common;i++) {
+        if (mLines->getString(firstLine-1+i) != newLines[i])
+            mLines->putString(firstLine-1+i, newLines[i], false);
+    }
+    if (newCount > oldCount) {
+        mLines->insertStrings(firstLine-1+common, newLines.mid(common));
+        doLinesInserted(firstLine+common, newCount-common);
+    } else if (newCount < oldCount) {
+        mLines->deleteLines(firstLine-1+common, oldCount-common);
+        doLinesDeleted(firstLine+common, oldCount-common);
+    }
+    // rescan the ranges of the changed lines once
+    onLinesPutted(firstLine-1, common);
+    if (changeStart != newEnd) {
+        mUndoList->AddChange(
+                    SynChangeReason::crInsert, changeStart, newEnd,
+                    "", SynSelectionMode::smNormal);
+    }
+    setCaretAndSelection(newEnd, newEnd, newEnd);
+    ensureCursorPosVisible();
+}
+
+QVector<SynSearchMatch> SynEdit::findAllMatches(PSynSearchBase searchEngine, int fromLine, int toLine)
+{
+    fromLine = std::max(1,fromLine);
+    toLine = std::min(mLines->count(),toLine);
+    if (!searchEngine || fromLine>toLine)
+        return QVector<SynSearchMatch>();
+    QStringList lines;
+    lines.reserve(toLine-fromLine+1);
+    for (int line=fromLine;line<=toLine;line++)
+        lines.append(mLines->getString(line-1));
+    return searchEngine->findAllInLines(lines, fromLine);
+}
+
+void SynEdit::setMatchHighlight(const QString &pattern, SynSearchOptions options,
+                                const QList<SynHighlighterTokenType>& tokenTypes)
+{
+    //mapped files don't keep the matches of their lines, they would be searched on every paint
+    if (pattern.isEmpty() || mLines->mapped()) {
+        clearMatchHighlight();
+        return;
+    }
+    if (options.testFlag(ssoRegExp))
+        mMatchSearchEngine = std::make_shared<SynSearchRegex>();
+    else
+        mMatchSearchEngine = std::make_shared<SynSearch>();
+    mMatchSearchEngine->setOptions(options);
+    mMatchSearchEngine->setPattern(pattern);
+    mMatchTokenTypes = tokenTypes;
+    //lines searched for the old pattern have an old serial
+    mMatchSerial++;
+    mMatchLines.clear();
+    mMatchScanLine = 0;
+    mMatchScanTimer->start();
+    invalidate();
+}
+
+void SynEdit::clearMatchHighlight()
+{
+    if (!mMatchSearchEngine)
+        return;
+    mMatchSearchEngine.reset();
+    mMatchSerial++;
+    mMatchLines.clear();
+    mMatchScanLine = 0;
+    mMatchScanTimer->stop();
+    updateMatchMarks();
+    invalidate();
+}
+
+QVector<SynEditLineMatch> SynEdit::lineMatches(int line)
+{
+    QVector<SynEditLineMatch> matches;
+    if (!mMatchSearchEngine || mLines->mapped())
+        return matches;
+    if (mLines->lineMatches(line,mMatchSerial,matches))
+        return matches;
+    int count = mMatchSearchEngine->findAll(mLines->getString(line));
+    matches.reserve(count);
+    //the tokens are only needed if there are matches
+    PSynEditLineTokens tokens;
+    if (count>0 && mHighlighter && !mMatchTokenTypes.isEmpty())
+        tokens = lineTokens(line);
+    int tokenIndex = 0;
+    for (int i=0;i<count;i++) {
+        SynEditLineMatch match;
+        match.start = mMatchSearchEngine->result(i);
+        match.length = mMatchSearchEngine->length(i);
+        if (match.length<=0)
+            continue;
+        if (tokens) {
+            //results are in order, so are the tokens
+            while (tokenIndex+1 < tokens->tokens.count()
+                   && tokens->tokens[tokenIndex+1].pos <= match.start)
+                tokenIndex++;
+            if (tokenIndex >= tokens->tokens.count()
+                    || !mMatchTokenTypes.contains(tokens->tokens[tokenIndex].type))
+                continue;
+        }
+        matches.append(match);
+    }
+    mLines->setLineMatches(line,mMatchSerial,matches);
+    return matches;
+}
+
 void SynEdit::doLinesDeleted(int firstLine, int count)
 {
     emit linesDeleted(firstLine, count);
@@ -5163,6 +6195,8 @@ int SynEdit::insertTextByNormalMode(const QString &Value)
     // step1: insert the first line of Value into current line
     Start = 0;
     P = GetEOL(Value,Start);
+    //big pastes are inserted at once and as they are, without indenting each line
+    bool bulk = (P<Value.length()) && (CountLines(Value,P) >= BULK_INSERT_LINES);
     if (P<Value.length()) {
         QString s = trimLeft(Value.mid(0, P - Start));
         if (sLeftSide.isEmpty()) {
@@ -5170,14 +6204,38 @@ int SynEdit::insertTextByNormalMode(const QString &Value)
         }
         Str = sLeftSide + s;
         properSetLine(caretY - 1, Str);
-        mLines->insertLines(caretY, CountLines(Value,P));
+        if (!bulk)
+            mLines->insertLines(caretY, CountLines(Value,P));
     } else {
         Str = sLeftSide + Value + sRightSide;
         properSetLine(caretY - 1, Str);
     }
     rescanRange(caretY);
     // step2: insert remaining lines of Value
-    while (P < Value.length()) {
+    if (bulk) {
+        QStringList newLines;
+        while (P < Value.length()) {
+            if (Value[P] == '\r')
+                P++;
+            if (P < Value.length() && Value[P] == '\n')
+                P++;
+            Start = P;
+            P = GetEOL(Value,Start);
+            Str = Value.mid(Start, P-Start);
+            if (P>=Value.length())
+                Str += sRightSide;
+            if (mOptions.testFlag(eoTrimTrailingSpaces))
+                newLines.append(trimRight(Str));
+            else
+                newLines.append(Str);
+        }
+        // one inserted notification, which rescans the ranges and folds of the new lines
+        mLines->insertStrings(caretY, newLines);
+        Result = newLines.count();
+        caretY += Result;
+        mStatusChanges.setFlag(SynStatusChange::scCaretY);
+    }
+    while (!bulk && P < Value.length()) {
         if (Value[P] == '\r')
             P++;
         if (Value[P] == '\n')
@@ -5214,7 +6272,10 @@ int SynEdit::insertTextByNormalMode(const QString &Value)
           internalSetCaretXY(BufferCoord{lineText().length()+1,caretY});
     } else
         internalSetCaretXY(BufferCoord{Str.length() - sRightSide.length()+1,caretY});
-    onLinesPutted(startLine-1,Result+1);
+    if (bulk)
+        onLinesPutted(startLine-1,1);
+    else
+        onLinesPutted(startLine-1,Result+1);
     return Result;
 }
 
@@ -5941,6 +7002,7 @@ bool SynEdit::event(QEvent *event)
     }
         break;
     case QEvent::FontChange:
+    case QEvent::ScreenChangeInternal: // glyph widths change with the screen's dpi
         synFontChanged();
         break;
     case QEvent::MouseMove: {
@@ -6380,6 +7442,9 @@ void SynEdit::onLinesChanging()
 
 void SynEdit::onLinesCleared()
 {
+    invalidateBracketIndex();
+    mLines->setFirstUnscannedLine(INT_MAX);
+    scheduleMatchScan(0);
     if (mUseCodeFolding)
         foldOnListCleared();
     clearUndo();
@@ -6396,16 +7461,45 @@ void SynEdit::onLinesCleared()
 
 void SynEdit::onLinesDeleted(int index, int count)
 {
+    bracketIndexLinesDeleted(index, count);
+    int firstUnscanned = mLines->firstUnscannedLine();
+    if (firstUnscanned > index && firstUnscanned < INT_MAX)
+        mLines->setFirstUnscannedLine(std::max(index, firstUnscanned - count));
+    if (mMatchSearchEngine) {
+        //lines after the deleted ones move up
+        QVector<int>::iterator it = mMatchLines.erase(
+                    std::lower_bound(mMatchLines.begin(),mMatchLines.end(),index),
+                    std::lower_bound(mMatchLines.begin(),mMatchLines.end(),index+count));
+        for (;it!=mMatchLines.end();++it)
+            *it -= count;
+        if (mMatchScanLine > index)
+            mMatchScanLine = std::max(index, mMatchScanLine - count);
+        updateMatchMarks();
+    }
     if (mUseCodeFolding)
         foldOnListDeleted(index + 1, count);
     if (mHighlighter && mLines->count() > 0)
         scanFrom(index, index+1);
+    updateFolds();
     invalidateLines(index + 1, INT_MAX);
     invalidateGutterLines(index + 1, INT_MAX);
 }
 
 void SynEdit::onLinesInserted(int index, int count)
 {
+    bracketIndexLinesInserted(index, count);
+    int firstUnscanned = mLines->firstUnscannedLine();
+    if (firstUnscanned > index && firstUnscanned < INT_MAX)
+        mLines->setFirstUnscannedLine(firstUnscanned + count);
+    if (mMatchSearchEngine) {
+        //lines after the inserted ones move down
+        for (QVector<int>::iterator it = std::lower_bound(mMatchLines.begin(),mMatchLines.end(),index);
+             it!=mMatchLines.end();++it)
+            *it += count;
+        if (mMatchScanLine > index)
+            mMatchScanLine += count;
+        rescanMatchLines(index, count);
+    }
     if (mUseCodeFolding)
         foldOnListInserted(index + 1, count);
     if (mHighlighter && mLines->count() > 0) {
@@ -6422,6 +7516,7 @@ void SynEdit::onLinesInserted(int index, int count)
 void SynEdit::onLinesPutted(int index, int count)
 {
     int vEndLine = index + 1;
+    rescanMatchLines(index, count);
     if (mHighlighter) {
         vEndLine = std::max(vEndLine, scanFrom(index, index+count) + 1);
         // If this editor is chained then the real owner of text buffer will probably
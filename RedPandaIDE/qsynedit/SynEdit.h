@@ -244,6 +244,23 @@ public:
 
     int searchReplace(const QString& sSearch, const QString& sReplace, SynSearchOptions options,
                PSynSearchBase searchEngine,  SynSearchMathedProc matchedCallback = nullptr);
+    // Find all matches of the search engine's pattern in the lines fromLine..toLine (1-based).
+    // The lines are searched as one text joined by '\n', so a match can span lines.
+    QVector<SynSearchMatch> findAllMatches(PSynSearchBase searchEngine, int fromLine, int toLine);
+    // Replace the matches (sorted, found in the current text) in one change and one undo block.
+    void replaceMatches(const QVector<SynSearchMatch>& matches, PSynSearchBase searchEngine,
+                        const QString& sReplace);
+    /*
+     * Highlight all the matches of the pattern. Lines are searched when painted,
+     * and the whole text in idle time for the scroll bar marks.
+     * If tokenTypes is not empty, only the matches starting in tokens of these types
+     * are highlighted. Mapped files are not highlighted.
+     */
+    void setMatchHighlight(const QString& pattern, SynSearchOptions options,
+                           const QList<SynHighlighterTokenType>& tokenTypes = QList<SynHighlighterTokenType>());
+    void clearMatchHighlight();
+    // highlighted matches of the line (0-based)
+    QVector<SynEditLineMatch> lineMatches(int line);
 
     int maxScrollWidth() const;
     int maxScrollHeight() const;
@@ -331,6 +348,10 @@ public:
 
     const PSynEditStringList& lines() const;
     bool empty();
+    //computes the ranges of lines that are not scanned yet, up to line (0-based)
+    void scanRangesTo(int line);
+    //highlighter tokens of the line (0-based), lexed only if they are not cached
+    PSynEditLineTokens lineTokens(int line);
 
     SynSelectionMode selectionMode() const;
     void setSelectionMode(SynSelectionMode value);
@@ -376,6 +397,12 @@ public:
     const QColor &selectedBackground() const;
     void setSelectedBackground(const QColor &newSelectedBackground);
 
+    const QColor &matchForeground() const;
+    void setMatchForeground(const QColor &newMatchForeground);
+
+    const QColor &matchBackground() const;
+    void setMatchBackground(const QColor &newMatchBackground);
+
     int rightEdge() const;
     void setRightEdge(int newRightEdge);
 
@@ -480,6 +507,14 @@ private:
     QString expandAtWideGlyphs(const QString& S);
     void updateModifiedStatus();
     int scanFrom(int Index, int canStopIndex);
+    int lastVisibleLineIndex();
+    PSynEditLineTokens tokenizeLine(const QString& lineText, int line);
+    void readLineTokens(SynEditLineTokens& lineTokens);
+    void scheduleRangeScan();
+    void scheduleMatchScan(int fromLine);
+    void rescanMatchLines(int index, int count);
+    void invalidateLineMatches(int fromLine, int toLine);
+    void updateMatchMarks();
     void rescanRange(int line);
     void rescanRanges();
     void uncollapse(PSynEditFoldRange FoldRange);
@@ -489,6 +524,19 @@ private:
     void foldOnListDeleted(int Line, int Count);
     void foldOnListCleared();
     void rescanFolds(); // rescan for folds
+    void markFoldsDirty(int fromLine, int toLine);
+    void updateFolds(); // rescan folds affected by the lines marked dirty
+    bool rescanBraceFoldRanges(int fromLine, int toLine);
+    void invalidateFoldIndex();
+    void ensureFoldIndex() const;
+    void invalidateBracketIndex();
+    void markBracketIndexDirty(int fromLine, int toLine);
+    void bracketIndexLinesInserted(int index, int count);
+    void bracketIndexLinesDeleted(int index, int count);
+    bool ensureBracketIndex();
+    int lineStartBracketLevel(int kind, int line);
+    bool findOpenBracket(int kind, int line, int pos, bool atBracket, BufferCoord& result);
+    bool findCloseBracket(int kind, int line, int pos, BufferCoord& result);
     void rescanForFoldRanges();
     void scanForFoldRanges(PSynEditFoldRanges TopFoldRanges);
     int lineHasChar(int Line, int startChar, QChar character, const QString& highlighterAttrName);
@@ -599,12 +647,34 @@ private slots:
     void onSizeOrFontChanged(bool bFont);
     void onChanged();
     void onScrolled(int value);
+    void onRangeScanTimeout();
+    void onMatchScanTimeout();
 
 private:
     std::shared_ptr<QImage> mContentImage;
     SynEditFoldRanges mAllFoldRanges;
     SynEditCodeFolding mCodeFolding;
     bool mUseCodeFolding;
+    //lines (0-based) whose braces changed since folds were last scanned
+    int mFoldsDirtyFrom;
+    int mFoldsDirtyTo;
+    //sorted lines of the visible collapsed folds, for foldRowToLine()/foldLineToRow()
+    mutable bool mFoldIndexValid;
+    mutable QVector<int> mFoldIndexFromLines;
+    mutable QVector<int> mFoldIndexToLines;
+    mutable QVector<int> mFoldIndexRows; // row of each fold's first line
+    mutable QVector<int> mFoldIndexCollapsedBefore; // lines hidden by the folds before each one
+    //segment trees over the lines of their lowest parenthesis/bracket/brace levels,
+    //to find the line of a matching bracket without scanning the lines between
+    bool mBracketIndexValid;
+    int mBracketIndexSize; // leaves of each tree, a power of 2
+    int mBracketIndexCount; // lines the leaves are kept for
+    QVector<int> mBracketIndex[3];
+    //leaves to recompute from the ranges of their lines, and leaves whose nodes are out of date
+    int mBracketLeavesDirtyFrom;
+    int mBracketLeavesDirtyTo;
+    int mBracketNodesDirtyFrom;
+    int mBracketNodesDirtyTo;
     bool  mAlwaysShowCaret;
     BufferCoord mBlockBegin;
     BufferCoord mBlockEnd;
@@ -613,6 +683,9 @@ private:
     int mCaretY;
     int mCharsInWindow;
     int mCharWidth;
+    //columns of each char for the current font, filled by recalcCharExtent()
+    int mAsciiCharColumns[128];
+    mutable QHash<ushort,int> mCharColumnsCache;
     QFont mFontDummy;
     SynFontSmoothMethod mFontSmoothing;
     bool mMouseMoved;
@@ -640,6 +713,8 @@ private:
     PSynHighlighter mHighlighter;
     QColor mSelectedForeground;
     QColor mSelectedBackground;
+    QColor mMatchForeground;
+    QColor mMatchBackground;
     QColor mForegroundColor;
     QColor mBackgroundColor;
     QColor mCaretColor;
@@ -683,6 +758,15 @@ private:
     //  fFocusList: TList;
     //  fPlugins: TList;
     QTimer*  mScrollTimer;
+    QTimer*  mRangeScanTimer;
+    //highlighted matches
+    PSynSearchBase mMatchSearchEngine;
+    QList<SynHighlighterTokenType> mMatchTokenTypes;
+    int mMatchSerial;
+    int mMatchScanLine; //lines before it are searched by the idle scan
+    QVector<int> mMatchLines; //sorted lines (0-based) which have matches, before mMatchScanLine
+    QTimer* mMatchScanTimer;
+    SynEditScrollBar* mVerticalScrollBar;
     int mScrollDeltaX;
     int mScrollDeltaY;
 
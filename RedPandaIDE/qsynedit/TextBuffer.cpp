@@ -17,14 +17,20 @@
 #include "TextBuffer.h"
 #include <QDataStream>
 #include <QFile>
+#include <QFileInfo>
 #include <QTextCodec>
 #include <QTextStream>
 #include <QMutexLocker>
 #include <stdexcept>
+#include <algorithm>
 #include "SynEdit.h"
+#include "Constants.h"
 #include "../utils.h"
 #include "../platform.h"
 #include <QMessageBox>
+#include <QElapsedTimer>
+#include <cstring>
+#include <climits>
 
 SynEditStringList::SynEditStringList(SynEdit *pEdit, QObject *parent):
       QObject(parent),
@@ -32,21 +38,77 @@ SynEditStringList::SynEditStringList(SynEdit *pEdit, QObject *parent):
 {
     mAppendNewLineAtEOF = true;
     mFileEndingType = FileEndingType::Windows;
-    mIndexOfLongestLine = -1;
+    mUncountedLines = 0;
+    mFirstUnscannedLine = INT_MAX;
+    mRangePoolSize = 0;
+    mRangePoolPurgeSize = 1024;
     mUpdateCount = 0;
+    mMappedData = nullptr;
+    mMappedSize = 0;
+    mMappedIndexedEnd = 0;
+    mMappedLongestLine = 0;
+    mMappedLongestLineIndex = -1;
+    mMappedLongestLineColumns = -1;
+    mMappedFileShrunk = false;
+    mMappedCodec = nullptr;
+    mIndexThread = nullptr;
+}
+
+SynEditStringList::~SynEditStringList()
+{
+    releaseMappedFile();
 }
 
 static void ListIndexOutOfBounds(int index) {
     throw IndexOutOfRange(index);
 }
 
+static const PSynRangeState& defaultRangeState()
+{
+    static PSynRangeState range = std::make_shared<SynRangeState>(SynRangeState{0,0,0,0,0});
+    return range;
+}
+
+static uint hashRangeState(const SynRangeState& range)
+{
+    uint h = qHash(range.state);
+    h = h*31 + qHash(range.braceLevel);
+    h = h*31 + qHash(range.bracketLevel);
+    h = h*31 + qHash(range.parenthesisLevel);
+    h = h*31 + qHash(range.leftBraces);
+    h = h*31 + qHash(range.rightBraces);
+    h = h*31 + qHash(range.minBracketLevel);
+    h = h*31 + qHash(range.minParenthesisLevel);
+    h = h*31 + qHash(range.firstIndentThisLine);
+    h = h*31 + qHash(range.indents);
+    h = h*31 + qHash(range.matchingIndents);
+    return h;
+}
+
+//SynRangeState::operator== only compares what the highlighter needs, interning must compare all
+static bool rangeStatesEqual(const SynRangeState& r1, const SynRangeState& r2)
+{
+    return r1.state == r2.state
+            && r1.braceLevel == r2.braceLevel
+            && r1.bracketLevel == r2.bracketLevel
+            && r1.parenthesisLevel == r2.parenthesisLevel
+            && r1.leftBraces == r2.leftBraces
+            && r1.rightBraces == r2.rightBraces
+            && r1.minBracketLevel == r2.minBracketLevel
+            && r1.minParenthesisLevel == r2.minParenthesisLevel
+            && r1.firstIndentThisLine == r2.firstIndentThisLine
+            && r1.indents == r2.indents
+            && r1.matchingIndents == r2.matchingIndents;
+}
+
 
 
 int SynEditStringList::parenthesisLevels(int Index)
 {
     QMutexLocker locker(&mMutex);
-    if (Index>=0 && Index < mList.size()) {
-        return mList[Index]->fRange.parenthesisLevel;
+    if (Index>=0 && Index < mList.count()) {
+        ensureRangeScanned(Index);
+        return mList[Index]->fRange->parenthesisLevel;
     } else
         return 0;
 }
@@ -54,8 +116,9 @@ int SynEditStringList::parenthesisLevels(int Index)
 int SynEditStringList::bracketLevels(int Index)
 {
     QMutexLocker locker(&mMutex);
-    if (Index>=0 && Index < mList.size()) {
-        return mList[Index]->fRange.bracketLevel;
+    if (Index>=0 && Index < mList.count()) {
+        ensureRangeScanned(Index);
+        return mList[Index]->fRange->bracketLevel;
     } else
         return 0;
 }
@@ -63,15 +126,16 @@ int SynEditStringList::bracketLevels(int Index)
 int SynEditStringList::braceLevels(int Index)
 {
     QMutexLocker locker(&mMutex);
-    if (Index>=0 && Index < mList.size()) {
-        return mList[Index]->fRange.braceLevel;
+    if (Index>=0 && Index < mList.count()) {
+        ensureRangeScanned(Index);
+        return mList[Index]->fRange->braceLevel;
     } else
         return 0;
 }
 
 //QString SynEditStringList::expandedStrings(int Index)
 //{
-//    if (Index>=0 && Index < mList.size()) {
+//    if (Index>=0 && Index < mList.count()) {
 //        if (mList[Index]->fFlags & SynEditStringFlag::sfHasNoTabs)
 //            return mList[Index]->fString;
 //        else
@@ -83,7 +147,9 @@ int SynEditStringList::braceLevels(int Index)
 int SynEditStringList::lineColumns(int Index)
 {
     QMutexLocker locker(&mMutex);
-    if (Index>=0 && Index < mList.size()) {
+    if (mMappedFile)
+        return mEdit->stringColumns(getMappedString(Index),0);
+    if (Index>=0 && Index < mList.count()) {
         if (mList[Index]->fColumns == -1) {
             return calculateLineColumns(Index);
         } else
@@ -92,11 +158,84 @@ int SynEditStringList::lineColumns(int Index)
         return 0;
 }
 
+int SynEditStringList::charsColumns(int Index, int CharCount)
+{
+    QMutexLocker locker(&mMutex);
+    if (mMappedFile) {
+        QString s = getMappedString(Index);
+        return mEdit->stringColumns(s.left(std::max(0,CharCount)),0);
+    }
+    if (Index<0 || Index >= mList.count() || CharCount<=0)
+        return 0;
+    ensureLineColumns(Index);
+    PSynEditStringRec line = mList[Index];
+    int len = std::min(CharCount, line->fString.length());
+    if (line->fFlags & SynEditStringFlag::sfSingleWidth)
+        return len;
+    int k = len / ColumnIndexStep;
+    if (!line->fExtra || k >= line->fExtra->columnIndex.count())
+        return line->fColumns;
+    int x = line->fExtra->columnIndex[k];
+    int tabWidth = mEdit->tabWidth();
+    const QChar* chars = line->fString.constData();
+    for (int i=k*ColumnIndexStep;i<len;i++) {
+        if (chars[i] == '\t')
+            x+=tabWidth - (x % tabWidth);
+        else
+            x+=mEdit->charColumns(chars[i]);
+    }
+    return x;
+}
+
+int SynEditStringList::columnToCharIndex(int Index, int Column)
+{
+    QMutexLocker locker(&mMutex);
+    QString s;
+    int len;
+    int start = 0;
+    int x = 0;
+    if (mMappedFile) {
+        s = getMappedString(Index);
+        len = s.length();
+    } else {
+        if (Index<0 || Index >= mList.count())
+            return 0;
+        ensureLineColumns(Index);
+        PSynEditStringRec line = mList[Index];
+        len = line->fString.length();
+        if (line->fFlags & SynEditStringFlag::sfSingleWidth)
+            return std::min(std::max(Column-1,0),len);
+        if (Column > line->fColumns)
+            return len;
+        // the last indexed char with less than Column columns before it
+        QVector<int> index = line->fExtra ? line->fExtra->columnIndex : QVector<int>();
+        int k = std::lower_bound(index.begin(),index.end(),Column) - index.begin() - 1;
+        if (k>0) {
+            start = k*ColumnIndexStep;
+            x = index[k];
+        }
+        s = line->fString;
+    }
+    int tabWidth = mEdit->tabWidth();
+    const QChar* chars = s.constData();
+    int i;
+    for (i=start;i<len;i++) {
+        if (chars[i] == '\t')
+            x+=tabWidth - (x % tabWidth);
+        else
+            x+=mEdit->charColumns(chars[i]);
+        if (x>=Column)
+            break;
+    }
+    return i;
+}
+
 int SynEditStringList::leftBraces(int Index)
 {
     QMutexLocker locker(&mMutex);
-    if (Index>=0 && Index < mList.size()) {
-        return mList[Index]->fRange.leftBraces;
+    if (Index>=0 && Index < mList.count()) {
+        ensureRangeScanned(Index);
+        return mList[Index]->fRange->leftBraces;
     } else
         return 0;
 }
@@ -104,31 +243,33 @@ int SynEditStringList::leftBraces(int Index)
 int SynEditStringList::rightBraces(int Index)
 {
     QMutexLocker locker(&mMutex);
-    if (Index>=0 && Index < mList.size()) {
-        return mList[Index]->fRange.rightBraces;
+    if (Index>=0 && Index < mList.count()) {
+        ensureRangeScanned(Index);
+        return mList[Index]->fRange->rightBraces;
     } else
         return 0;
 }
 
 int SynEditStringList::lengthOfLongestLine() {
     QMutexLocker locker(&mMutex);
-    if (mIndexOfLongestLine < 0) {
-        int MaxLen = -1;
-        mIndexOfLongestLine = -1;
-        if (mList.count() > 0 ) {
-            for (int i=0;i<mList.size();i++) {
-                int len = lineColumns(i);
-                if (len > MaxLen) {
-                    MaxLen = len;
-                    mIndexOfLongestLine = i;
-                }
-            }
+    if (mMappedFile) {
+        //an estimate: the columns of the line with the most bytes, the other lines are not decoded
+        if (mMappedLongestLineIndex<0)
+            return 0;
+        if (mMappedLongestLineColumns<0) {
+            QString s = getMappedString(mMappedLongestLineIndex);
+            mMappedLongestLineColumns = mEdit?mEdit->stringColumns(s,0):s.length();
         }
+        return mMappedLongestLineColumns;
     }
-    if (mIndexOfLongestLine >= 0)
-        return mList[mIndexOfLongestLine]->fColumns;
-    else
+    //columns of all lines are invalid after a font or tab width change
+    for (int i=0;i<mList.count() && mUncountedLines>0;i++) {
+        if (mList[i]->fColumns == -1)
+            calculateLineColumns(i);
+    }
+    if (mLineColumnsCount.isEmpty())
         return 0;
+    return mLineColumnsCount.lastKey();
 }
 
 QString SynEditStringList::lineBreak() const
@@ -147,21 +288,163 @@ QString SynEditStringList::lineBreak() const
 SynRangeState SynEditStringList::ranges(int Index)
 {
     QMutexLocker locker(&mMutex);
-    if (Index>=0 && Index < mList.size()) {
-        return mList[Index]->fRange;
+    //ranges are not kept for mapped files, each line is highlighted from the default state
+    if (mMappedFile)
+        return {0};
+    if (Index>=0 && Index < mList.count()) {
+        ensureRangeScanned(Index);
+        return *(mList[Index]->fRange);
     } else {
          ListIndexOutOfBounds(Index);
     }
     return {0};
 }
 
+PSynRangeState SynEditStringList::rangeHandle(int Index)
+{
+    QMutexLocker locker(&mMutex);
+    if (mMappedFile)
+        return defaultRangeState();
+    if (Index>=0 && Index < mList.count()) {
+        ensureRangeScanned(Index);
+        return mList[Index]->fRange;
+    } else {
+         ListIndexOutOfBounds(Index);
+    }
+    return defaultRangeState();
+}
+
+PSynRangeState SynEditStringList::internRange(const SynRangeState &ARange)
+{
+    QMutexLocker locker(&mMutex);
+    uint hash = hashRangeState(ARange);
+    QVector<PSynRangeState>& bucket = mRangePool[hash];
+    foreach (const PSynRangeState& range, bucket) {
+        if (rangeStatesEqual(*range,ARange))
+            return range;
+    }
+    //drop the states no line uses any more, when the pool has grown a lot
+    if (mRangePoolSize >= mRangePoolPurgeSize) {
+        for (auto it=mRangePool.begin();it!=mRangePool.end();) {
+            QVector<PSynRangeState>& ranges = it.value();
+            for (int i=ranges.count()-1;i>=0;i--) {
+                if (ranges[i].use_count()==1) {
+                    ranges.remove(i);
+                    mRangePoolSize--;
+                }
+            }
+            if (ranges.isEmpty() && it.key()!=hash)
+                it = mRangePool.erase(it);
+            else
+                it++;
+        }
+        mRangePoolPurgeSize = std::max(1024, mRangePoolSize*2);
+    }
+    PSynRangeState range = std::make_shared<SynRangeState>(ARange);
+    mRangePool[hash].append(range);
+    mRangePoolSize++;
+    return range;
+}
+
+static void dropCachedTokens(const std::weak_ptr<SynEditStringRec>& cachedLine)
+{
+    PSynEditStringRec line = cachedLine.lock();
+    if (!line || !line->fExtra)
+        return;
+    line->fExtra->tokens.reset();
+    line->fExtra->tokensQueued = false;
+    line->releaseExtraIfEmpty();
+}
+
+PSynEditLineTokens SynEditStringList::lineTokens(int Index)
+{
+    QMutexLocker locker(&mMutex);
+    if (mMappedFile)
+        return PSynEditLineTokens();
+    if (Index<0 || Index >= mList.count())
+        return PSynEditLineTokens();
+    if (!mList[Index]->fExtra)
+        return PSynEditLineTokens();
+    PSynEditLineTokens tokens = mList[Index]->fExtra->tokens;
+    if (!tokens)
+        return tokens;
+    PSynRangeState startRange;
+    if (Index>0)
+        startRange = rangeHandle(Index-1);
+    if (tokens->startRange != startRange)
+        return PSynEditLineTokens();
+    return tokens;
+}
+
+void SynEditStringList::setLineTokens(int Index, const PSynEditLineTokens &tokens)
+{
+    QMutexLocker locker(&mMutex);
+    if (mMappedFile)
+        return;
+    if (Index<0 || Index >= mList.count())
+        return;
+    const PSynEditStringRec& line = mList[Index];
+    SynEditLineExtra& extra = line->extra();
+    extra.tokens = tokens;
+    if (!extra.tokensQueued) {
+        extra.tokensQueued = true;
+        mTokenCachedLines.enqueue(line);
+        //don't keep the tokens of every line we have ever painted
+        while (mTokenCachedLines.count() > MaxTokenCachedLines)
+            dropCachedTokens(mTokenCachedLines.dequeue());
+    }
+}
+
+void SynEditStringList::clearLineTokens()
+{
+    QMutexLocker locker(&mMutex);
+    while (!mTokenCachedLines.isEmpty())
+        dropCachedTokens(mTokenCachedLines.dequeue());
+}
+
+bool SynEditStringList::lineMatches(int Index, int serial, QVector<SynEditLineMatch> &matches)
+{
+    QMutexLocker locker(&mMutex);
+    if (mMappedFile)
+        return false;
+    if (Index<0 || Index >= mList.count())
+        return false;
+    const PSynEditStringRec& line = mList[Index];
+    if (line->fMatchSerial != serial)
+        return false;
+    if (line->fExtra)
+        matches = line->fExtra->matches;
+    else
+        matches.clear();
+    return true;
+}
+
+void SynEditStringList::setLineMatches(int Index, int serial, const QVector<SynEditLineMatch> &matches)
+{
+    QMutexLocker locker(&mMutex);
+    if (mMappedFile)
+        return;
+    if (Index<0 || Index >= mList.count())
+        return;
+    const PSynEditStringRec& line = mList[Index];
+    line->fMatchSerial = serial;
+    //most lines have no matches, don't allocate for them
+    if (!matches.isEmpty()) {
+        line->extra().matches = matches;
+    } else if (line->fExtra) {
+        line->fExtra->matches.clear();
+        line->releaseExtraIfEmpty();
+    }
+}
+
 void SynEditStringList::insertItem(int Index, const QString &s)
 {
     beginUpdate();
     PSynEditStringRec line = std::make_shared<SynEditStringRec>();
     line->fString = s;
-    mIndexOfLongestLine = -1;
     mList.insert(Index,line);
+    mUncountedLines++;
+    updateLineColumns(Index);
     endUpdate();
 }
 
@@ -170,8 +453,9 @@ void SynEditStringList::addItem(const QString &s)
     beginUpdate();
     PSynEditStringRec line = std::make_shared<SynEditStringRec>();
     line->fString = s;
-    mIndexOfLongestLine = -1;
     mList.append(line);
+    mUncountedLines++;
+    updateLineColumns(mList.count()-1);
     endUpdate();
 }
 
@@ -190,17 +474,28 @@ void SynEditStringList::setAppendNewLineAtEOF(bool appendNewLineAtEOF)
 void SynEditStringList::setRange(int Index, const SynRangeState& ARange)
 {
     QMutexLocker locker(&mMutex);
+    if (mMappedFile)
+        return;
+    setRange(Index,internRange(ARange));
+}
+
+void SynEditStringList::setRange(int Index, const PSynRangeState &ARange)
+{
+    QMutexLocker locker(&mMutex);
+    if (mMappedFile)
+        return;
     if (Index<0 || Index>=mList.count()) {
         ListIndexOutOfBounds(Index);
     }
-    beginUpdate();
+    //ranges are not text, changing them doesn't emit changing()/changed()
     mList[Index]->fRange = ARange;
-    endUpdate();
 }
 
 QString SynEditStringList::getString(int Index)
 {
     QMutexLocker locker(&mMutex);
+    if (mMappedFile)
+        return getMappedString(Index);
     if (Index<0 || Index>=mList.count()) {
         return QString();
     }
@@ -210,6 +505,8 @@ QString SynEditStringList::getString(int Index)
 int SynEditStringList::count()
 {
     QMutexLocker locker(&mMutex);
+    if (mMappedFile)
+        return mMappedLineStarts.count();
     return mList.count();
 }
 
@@ -243,7 +540,6 @@ void SynEditStringList::setContents(const QStringList &text)
     });
     internalClear();
     if (text.count() > 0) {
-        mIndexOfLongestLine = -1;
         int FirstAdded = mList.count();
 
         foreach (const QString& s,text) {
@@ -257,9 +553,16 @@ QStringList SynEditStringList::contents()
 {
     QMutexLocker locker(&mMutex);
     QStringList Result;
-    SynEditStringRecList list = mList;
-    foreach (const PSynEditStringRec& line, list) {
-        Result.append(line->fString);
+    if (mMappedFile) {
+        if (!checkMappedSize(mMappedIndexedEnd))
+            return Result;
+        for (int i=0;i<mMappedLineStarts.count();i++) {
+            Result.append(getMappedString(i,false));
+        }
+        return Result;
+    }
+    for (int i=0;i<mList.count();i++) {
+        Result.append(mList[i]->fString);
     }
     return Result;
 }
@@ -296,7 +599,6 @@ void SynEditStringList::addStrings(const QStringList &Strings)
 {
     QMutexLocker locker(&mMutex);
     if (Strings.count() > 0) {
-        mIndexOfLongestLine = -1;
         beginUpdate();
         auto action = finally([this]{
             endUpdate();
@@ -313,9 +615,11 @@ void SynEditStringList::addStrings(const QStringList &Strings)
 int SynEditStringList::getTextLength()
 {
     QMutexLocker locker(&mMutex);
+    if (mMappedFile)
+        return mMappedSize;
     int Result = 0;
-    foreach (const PSynEditStringRec& line, mList ) {
-        Result += line->fString.length();
+    for (int i=0;i<mList.count();i++) {
+        Result += mList[i]->fString.length();
         if (mFileEndingType == FileEndingType::Windows) {
             Result += 2;
         } else {
@@ -343,13 +647,12 @@ void SynEditStringList::deleteLines(int Index, int NumLines)
     auto action = finally([this]{
         endUpdate();
     });
-    if (mIndexOfLongestLine>=Index && (mIndexOfLongestLine <Index+NumLines)) {
-        mIndexOfLongestLine = - 1;
-    }
     int LinesAfter = mList.count() - (Index + NumLines);
     if (LinesAfter < 0) {
        NumLines = mList.count() - Index;
     }
+    for (int i=Index;i<Index+NumLines;i++)
+        countLineColumns(mList[i]->fColumns,-1);
     mList.remove(Index,NumLines);
     emit deleted(Index,NumLines);
 }
@@ -365,11 +668,6 @@ void SynEditStringList::exchange(int Index1, int Index2)
     }
     beginUpdate();
     mList.swapItemsAt(Index1,Index2);
-    if (mIndexOfLongestLine == Index1) {
-        mIndexOfLongestLine = Index2;
-    } else if (mIndexOfLongestLine == Index2) {
-        mIndexOfLongestLine = Index1;
-    }
     endUpdate();
 }
 
@@ -392,8 +690,7 @@ void SynEditStringList::deleteAt(int Index)
         ListIndexOutOfBounds(Index);
     }
     beginUpdate();
-    if (mIndexOfLongestLine == Index)
-        mIndexOfLongestLine = -1;
+    countLineColumns(mList[Index]->fColumns,-1);
     mList.removeAt(Index);
     emit deleted(Index,1);
     endUpdate();
@@ -402,12 +699,22 @@ void SynEditStringList::deleteAt(int Index)
 QString SynEditStringList::getTextStr() const
 {
     QString result;
+    if (mMappedFile) {
+        if (!checkMappedSize(mMappedIndexedEnd))
+            return result;
+        for (int i=0;i<mMappedLineStarts.count();i++) {
+            if (i>0)
+                result.append(lineBreak());
+            result.append(getMappedString(i,false));
+        }
+        return result;
+    }
     for (int i=0;i<mList.count()-1;i++) {
         const PSynEditStringRec& line = mList[i];
         result.append(line->fString);
         result.append(lineBreak());
     }
-    if (mList.length()>0) {
+    if (mList.count()>0) {
         result.append(mList.back()->fString);
     }
     return result;
@@ -422,9 +729,16 @@ void SynEditStringList::putString(int Index, const QString &s, bool notify) {
             ListIndexOutOfBounds(Index);
         }
         beginUpdate();
-        mIndexOfLongestLine = -1;
-        mList[Index]->fString = s;
-        mList[Index]->fColumns = -1;
+        const PSynEditStringRec& line = mList[Index];
+        line->fString = s;
+        line->fMatchSerial = 0;
+        if (line->fExtra) {
+            line->fExtra->tokens.reset();
+            line->fExtra->matches.clear();
+        }
+        updateLineColumns(Index);
+        if (line->fExtra)
+            line->releaseExtraIfEmpty();
         if (notify)
             emit putted(Index,1);
         endUpdate();
@@ -450,14 +764,88 @@ void SynEditStringList::setUpdateState(bool Updating)
         emit changed();
 }
 
-int SynEditStringList::calculateLineColumns(int Index)
+void SynEditStringList::updateLineColumns(int Index)
 {
+    if (mEdit) {
+        calculateLineColumns(Index);
+        return;
+    }
+    //buffers without an editor (used to read files) have no glyph widths, columns are computed when needed
     PSynEditStringRec line = mList[Index];
+    countLineColumns(line->fColumns,-1);
+    line->fColumns = -1;
+    countLineColumns(-1,1);
+}
 
-    line->fColumns = mEdit->stringColumns(line->fString,0);
+int SynEditStringList::calculateLineColumns(int Index)
+{
+    PSynEditStringRec line = mList[Index];
+    if (!mEdit)
+        return line->fString.length();
+    countLineColumns(line->fColumns,-1);
+    const QString& s = line->fString;
+    const QChar* chars = s.constData();
+    int len = s.length();
+    int tabWidth = mEdit->tabWidth();
+    int columns = 0;
+    SynEditStringFlags flags = SynEditStringFlag::sfSingleWidth;
+    QVector<int> columnIndex;
+    for (int i=0;i<len;i++) {
+        if (i % ColumnIndexStep == 0 && i>0 && !(flags & SynEditStringFlag::sfSingleWidth))
+            columnIndex.append(columns);
+        if (chars[i] == '\t') {
+            flags |= SynEditStringFlag::sfHasTabs;
+            columns += tabWidth - (columns % tabWidth);
+        } else {
+            int charCols = mEdit->charColumns(chars[i]);
+            columns += charCols;
+            if (charCols == 1)
+                continue;
+        }
+        if (flags & SynEditStringFlag::sfSingleWidth) {
+            // chars before this one all took one column
+            flags &= ~SynEditStringFlag::sfSingleWidth;
+            columnIndex.reserve(len / ColumnIndexStep + 1);
+            for (int j=0;j<=i;j+=ColumnIndexStep)
+                columnIndex.append(j);
+        }
+    }
+    if (!(flags & SynEditStringFlag::sfHasTabs))
+        flags |= SynEditStringFlag::sfHasNoTabs;
+    line->fFlags = flags;
+    if (!columnIndex.isEmpty()) {
+        line->extra().columnIndex = columnIndex;
+    } else if (line->fExtra) {
+        line->fExtra->columnIndex.clear();
+        line->releaseExtraIfEmpty();
+    }
+    line->fColumns = columns;
+    countLineColumns(columns,1);
     return line->fColumns;
 }
 
+void SynEditStringList::countLineColumns(int columns, int delta)
+{
+    if (columns == -1) {
+        mUncountedLines += delta;
+        return;
+    }
+    auto it = mLineColumnsCount.find(columns);
+    if (it == mLineColumnsCount.end()) {
+        mLineColumnsCount.insert(columns,delta);
+    } else {
+        it.value() += delta;
+        if (it.value()<=0)
+            mLineColumnsCount.erase(it);
+    }
+}
+
+void SynEditStringList::ensureLineColumns(int Index)
+{
+    if (mList[Index]->fColumns == -1)
+        calculateLineColumns(Index);
+}
+
 void SynEditStringList::insertLines(int Index, int NumLines)
 {
     QMutexLocker locker(&mMutex);
@@ -472,9 +860,10 @@ void SynEditStringList::insertLines(int Index, int NumLines)
     });
     PSynEditStringRec line;
     mList.insert(Index,NumLines,line);
+    mUncountedLines += NumLines;
     for (int i=Index;i<Index+NumLines;i++) {
-        line = std::make_shared<SynEditStringRec>();
-        mList[i]=line;
+        mList[i]=std::make_shared<SynEditStringRec>();
+        updateLineColumns(i);
     }
     emit inserted(Index,NumLines);
 }
@@ -493,10 +882,12 @@ void SynEditStringList::insertStrings(int Index, const QStringList &NewStrings)
     });
     PSynEditStringRec line;
     mList.insert(Index,NewStrings.length(),line);
+    mUncountedLines += NewStrings.length();
     for (int i=0;i<NewStrings.length();i++) {
         line = std::make_shared<SynEditStringRec>();
         line->fString = NewStrings[i];
         mList[i+Index]=line;
+        updateLineColumns(i+Index);
     }
     emit inserted(Index,NewStrings.length());
 }
@@ -523,82 +914,217 @@ void SynEditStringList::loadFromFile(const QString& filename, const QByteArray&
     auto action = finally([this]{
         endUpdate();
     });
-    //test for utf8 / utf 8 bom
+    //read the file at once, then validate and split it in place
+    QByteArray content = file.readAll();
+    const char* data = content.constData();
+    int size = content.length();
+    bool hasBOM = (size>=3) && ((unsigned char)data[0]==0xEF)
+            && ((unsigned char)data[1]==0xBB) && ((unsigned char)data[2]==0xBF);
+    int start = 0;
+    bool allAscii = false;
+    realEncoding = encoding;
     if (encoding == ENCODING_AUTO_DETECT) {
-        if (file.atEnd()) {
+        if (size == 0) {
+            internalClear();
             realEncoding = ENCODING_ASCII;
             return;
         }
-        QByteArray line = file.readLine();
-        QTextCodec* codec;
-        QTextCodec::ConverterState state;
-        bool needReread = false;
-        bool allAscii = true;
-        //test for BOM
-        if ((line.length()>=3) && ((unsigned char)line[0]==0xEF) && ((unsigned char)line[1]==0xBB) && ((unsigned char)line[2]==0xBF) ) {
-            realEncoding = ENCODING_UTF8_BOM;
-            line = line.mid(3);
-            codec = QTextCodec::codecForName(ENCODING_UTF8);
+        if (hasBOM)
+            start = 3;
+        //only fall back to the system codec after the whole file is checked
+        if (isTextValidUTF8(data+start,size-start,allAscii)) {
+            if (hasBOM)
+                realEncoding = ENCODING_UTF8_BOM;
+            else if (allAscii)
+                realEncoding = ENCODING_ASCII;
+            else
+                realEncoding = ENCODING_UTF8;
         } else {
-            realEncoding = ENCODING_UTF8;
-            codec = QTextCodec::codecForName(ENCODING_UTF8);
+            realEncoding = ENCODING_SYSTEM_DEFAULT;
+            start = 0;
         }
-        if (line.endsWith("\r\n")) {
-            mFileEndingType = FileEndingType::Windows;
-        } else if (line.endsWith("\n")) {
-            mFileEndingType = FileEndingType::Linux;
-        } else if (line.endsWith("\r")) {
+        const char* p = static_cast<const char*>(memchr(data+start,'\n',size-start));
+        if (p) {
+            if (p>data+start && *(p-1)=='\r')
+                mFileEndingType = FileEndingType::Windows;
+            else
+                mFileEndingType = FileEndingType::Linux;
+        } else if (data[size-1]=='\r') {
             mFileEndingType = FileEndingType::Mac;
         }
-        internalClear();
-        while (true) {
-            if (allAscii) {
-                allAscii = isTextAllAscii(line);
-            }
-            if (allAscii) {
-                addItem(trimRight(QString::fromLatin1(line)));
-            } else {
-                QString newLine = codec->toUnicode(line.constData(),line.length(),&state);
-                if (state.invalidChars>0) {
-                    needReread = true;
-                    break;
-                }
-                addItem(trimRight(newLine));
-            }
-            if (file.atEnd()){
-                break;
-            }
-            line = file.readLine();
-        }
-        emit inserted(0,mList.count());
-        if (!needReread) {
-            if (allAscii)
-                realEncoding = ENCODING_ASCII;
-            return;
-        }
-        realEncoding = ENCODING_SYSTEM_DEFAULT;
-    } else {
-        realEncoding = encoding;
+    } else if (realEncoding == ENCODING_UTF8_BOM && hasBOM) {
+        start = 3;
     }
 
     if (realEncoding == ENCODING_SYSTEM_DEFAULT) {
         realEncoding = pCharsetInfoManager->getDefaultSystemEncoding();
     }
-    file.reset();
-    QTextStream textStream(&file);
-    if (realEncoding == ENCODING_UTF8_BOM) {
-        textStream.setAutoDetectUnicode(true);
-        textStream.setCodec(ENCODING_UTF8);
+    internalClear();
+    if (allAscii || realEncoding == ENCODING_ASCII
+            || realEncoding == ENCODING_UTF8 || realEncoding == ENCODING_UTF8_BOM) {
+        //'\n' can't be a part of a multibyte utf8 char, so lines are split on the raw bytes
+        bool latin1 = allAscii || realEncoding == ENCODING_ASCII;
+        int pos = start;
+        while (pos < size) {
+            const char* p = static_cast<const char*>(memchr(data+pos,'\n',size-pos));
+            int lineEnd = p ? (p-data) : size;
+            if (latin1)
+                addItem(trimRight(QString::fromLatin1(data+pos,lineEnd-pos)));
+            else
+                addItem(trimRight(QString::fromUtf8(data+pos,lineEnd-pos)));
+            pos = lineEnd+1;
+        }
     } else {
-        textStream.setAutoDetectUnicode(false);
-        textStream.setCodec(realEncoding);
+        QTextCodec* codec = QTextCodec::codecForName(realEncoding);
+        if (!codec)
+            codec = QTextCodec::codecForLocale();
+        QString text = codec->toUnicode(data+start,size-start);
+        int pos = 0;
+        while (pos < text.length()) {
+            int lineEnd = text.indexOf('\n',pos);
+            if (lineEnd<0)
+                lineEnd = text.length();
+            addItem(trimRight(text.mid(pos,lineEnd-pos)));
+            pos = lineEnd+1;
+        }
     }
-    QString line;
+    emit inserted(0,mList.count());
+}
+
+void SynEditStringList::loadFromMappedFile(const QString &filename, const QByteArray &encoding, QByteArray &realEncoding)
+{
+    QMutexLocker locker(&mMutex);
+    std::shared_ptr<QFile> file = std::make_shared<QFile>(filename);
+    if (!file->open(QFile::ReadOnly ))
+        throw FileError(tr("Can't open file '%1' for read!").arg(file->fileName()));
+    uchar* data = file->map(0,file->size());
+    if (!data)
+        throw FileError(tr("Can't map file '%1' for read!").arg(file->fileName()));
+    beginUpdate();
+    auto action = finally([this]{
+        endUpdate();
+    });
     internalClear();
-    while (textStream.readLineInto(&line)) {
-        addItem(trimRight(line));
+    mMappedFile = file;
+    mMappedData = data;
+    mMappedSize = file->size();
+    qint64 start = 0;
+    realEncoding = encoding;
+    if (realEncoding == ENCODING_AUTO_DETECT || realEncoding == ENCODING_UTF8_BOM) {
+        //validating the whole file would defeat the purpose of mapping it,
+        //so only the BOM is checked; invalid bytes are shown as replacement chars.
+        if (mMappedSize>=3 && data[0]==0xEF && data[1]==0xBB && data[2]==0xBF) {
+            realEncoding = ENCODING_UTF8_BOM;
+            start = 3;
+        } else {
+            realEncoding = ENCODING_UTF8;
+        }
+        mMappedCodec = QTextCodec::codecForName(ENCODING_UTF8);
+    } else {
+        if (realEncoding == ENCODING_SYSTEM_DEFAULT)
+            realEncoding = pCharsetInfoManager->getDefaultSystemEncoding();
+        mMappedCodec = QTextCodec::codecForName(realEncoding);
     }
-    emit inserted(0,mList.count());
+    if (!mMappedCodec)
+        mMappedCodec = QTextCodec::codecForLocale();
+    const uchar* p = static_cast<const uchar*>(
+                memchr(data+start,'\n',std::min(mMappedSize-start,(qint64)65536)));
+    if (p) {
+        if (p>data+start && *(p-1)=='\r')
+            mFileEndingType = FileEndingType::Windows;
+        else
+            mFileEndingType = FileEndingType::Linux;
+    }
+    mMappedIndexedEnd = start;
+    mIndexThread = new SynEditLineIndexThread(filename,data,start,mMappedSize);
+    connect(mIndexThread,&SynEditLineIndexThread::linesIndexed,
+            this, &SynEditStringList::onMappedLinesIndexed);
+    connect(mIndexThread,&SynEditLineIndexThread::fileShrunk,
+            this, [this](){
+        checkMappedSize(mMappedSize);
+    });
+    mIndexThread->start();
+}
+
+bool SynEditStringList::mapped()
+{
+    QMutexLocker locker(&mMutex);
+    return (bool)mMappedFile;
+}
+
+void SynEditStringList::onMappedLinesIndexed(const QVector<qint64> &lineStarts, qint64 indexedEnd, int longestLine, qint64 longestLineStart)
+{
+    QMutexLocker locker(&mMutex);
+    //batches sent before the file is released are dropped
+    if (sender()!=mIndexThread || !mMappedFile)
+        return;
+    beginUpdate();
+    int oldCount = mMappedLineStarts.count();
+    mMappedLineStarts.append(lineStarts);
+    mMappedIndexedEnd = indexedEnd;
+    if (longestLine > mMappedLongestLine) {
+        mMappedLongestLine = longestLine;
+        mMappedLongestLineIndex = std::lower_bound(mMappedLineStarts.begin(),mMappedLineStarts.end(),longestLineStart)
+                - mMappedLineStarts.begin();
+        mMappedLongestLineColumns = -1;
+    }
+    emit inserted(oldCount,lineStarts.count());
+    endUpdate();
+}
+
+bool SynEditStringList::checkMappedSize(qint64 end) const
+{
+    //reading the mapping past the end of a truncated file crashes with SIGBUS
+    if (!mMappedFileShrunk && mMappedFile->size() >= end)
+        return true;
+    if (!mMappedFileShrunk) {
+        mMappedFileShrunk = true;
+        QMetaObject::invokeMethod(const_cast<SynEditStringList*>(this),[this](){
+            emit mappedFileShrunk();
+        },Qt::QueuedConnection);
+    }
+    return false;
+}
+
+QString SynEditStringList::getMappedString(int Index, bool checkSize) const
+{
+    if (Index<0 || Index>=mMappedLineStarts.count())
+        return QString();
+    qint64 start = mMappedLineStarts[Index];
+    qint64 end = (Index+1<mMappedLineStarts.count())?mMappedLineStarts[Index+1]:mMappedIndexedEnd;
+    if (checkSize && !checkMappedSize(end))
+        return QString();
+    while (end>start && (mMappedData[end-1]=='\n' || mMappedData[end-1]=='\r'))
+        end--;
+    const char* line = reinterpret_cast<const char*>(mMappedData+start);
+    if (isTextAllAscii(QByteArray::fromRawData(line,end-start)))
+        return trimRight(QString::fromLatin1(line,end-start));
+    return trimRight(mMappedCodec->toUnicode(line,end-start));
+}
+
+void SynEditStringList::releaseMappedFile()
+{
+    if (mIndexThread) {
+        disconnect(mIndexThread,nullptr,this,nullptr);
+        mIndexThread->stop();
+        mIndexThread->wait();
+        delete mIndexThread;
+        mIndexThread = nullptr;
+    }
+    if (mMappedFile) {
+        mMappedFile->unmap(mMappedData);
+        mMappedFile->close();
+        mMappedFile = nullptr;
+    }
+    mMappedData = nullptr;
+    mMappedSize = 0;
+    mMappedLineStarts.clear();
+    mMappedIndexedEnd = 0;
+    mMappedLongestLine = 0;
+    mMappedLongestLineIndex = -1;
+    mMappedLongestLineColumns = -1;
+    mMappedFileShrunk = false;
+    mMappedCodec = nullptr;
 }
 
 
@@ -607,6 +1133,10 @@ void SynEditStringList::saveToFile(QFile &file, const QByteArray& encoding,
                                    const QByteArray& defaultEncoding, QByteArray& realEncoding)
 {
     QMutexLocker locker(&mMutex);
+    if (mMappedFile) {
+        saveMappedToFile(file,realEncoding);
+        return;
+    }
     if (!file.open(QFile::WriteOnly | QFile::Truncate))
         throw FileError(tr("Can't open file '%1' for save!").arg(file.fileName()));
     if (mList.isEmpty())
@@ -629,7 +1159,8 @@ void SynEditStringList::saveToFile(QFile &file, const QByteArray& encoding,
     } else {
         codec = QTextCodec::codecForName(realEncoding);
     }
-    for (PSynEditStringRec& line:mList) {
+    for (int i=0;i<mList.count();i++) {
+        const PSynEditStringRec& line = mList[i];
         if (allAscii) {
             allAscii = isTextAllAscii(line->fString);
         }
@@ -651,6 +1182,28 @@ void SynEditStringList::saveToFile(QFile &file, const QByteArray& encoding,
     }
 }
 
+void SynEditStringList::saveMappedToFile(QFile &file, QByteArray &realEncoding)
+{
+    //a mapped buffer is read only, so the file is copied as is
+    if (!checkMappedSize(mMappedSize))
+        throw FileError(tr("File '%1' is truncated by another program!").arg(mMappedFile->fileName()));
+    if (mMappedSize>=3 && mMappedData[0]==0xEF && mMappedData[1]==0xBB && mMappedData[2]==0xBF)
+        realEncoding = ENCODING_UTF8_BOM;
+    else if (mMappedCodec->name() == "System")
+        realEncoding = pCharsetInfoManager->getDefaultSystemEncoding();
+    else
+        realEncoding = mMappedCodec->name();
+    //the mapped file itself is unchanged, and truncating it would break the mapping
+    QFileInfo mappedInfo(*mMappedFile);
+    QFileInfo info(file);
+    if (info.exists() && info.canonicalFilePath() == mappedInfo.canonicalFilePath())
+        return;
+    if (!file.open(QFile::WriteOnly | QFile::Truncate))
+        throw FileError(tr("Can't open file '%1' for save!").arg(file.fileName()));
+    if (file.write(reinterpret_cast<const char*>(mMappedData),mMappedSize)!=mMappedSize)
+        throw FileError(tr("Can't write to file '%1'!").arg(file.fileName()));
+}
+
 void SynEditStringList::putTextStr(const QString &text)
 {
     beginUpdate();
@@ -680,11 +1233,22 @@ void SynEditStringList::putTextStr(const QString &text)
 
 void SynEditStringList::internalClear()
 {
+    if (mMappedFile) {
+        beginUpdate();
+        int oldCount = mMappedLineStarts.count();
+        releaseMappedFile();
+        emit deleted(0,oldCount);
+        endUpdate();
+    }
     if (!mList.isEmpty()) {
         beginUpdate();
         int oldCount = mList.count();
-        mIndexOfLongestLine = -1;
         mList.clear();
+        mTokenCachedLines.clear();
+        mLineColumnsCount.clear();
+        mUncountedLines = 0;
+        mRangePool.clear();
+        mRangePoolSize = 0;
         emit deleted(0,oldCount);
         endUpdate();
     }
@@ -705,37 +1269,313 @@ void SynEditStringList::setFileEndingType(const FileEndingType &fileEndingType)
 bool SynEditStringList::empty()
 {
     QMutexLocker locker(&mMutex);
+    if (mMappedFile)
+        return mMappedLineStarts.isEmpty();
     return mList.count()==0;
 }
 
 void SynEditStringList::resetColumns()
 {
     QMutexLocker locker(&mMutex);
-    mIndexOfLongestLine = -1;
+    mMappedLongestLineColumns = -1;
     if (mList.count() > 0 ) {
-        for (int i=0;i<mList.size();i++) {
+        for (int i=0;i<mList.count();i++) {
             mList[i]->fColumns = -1;
         }
     }
+    mLineColumnsCount.clear();
+    mUncountedLines = mList.count();
+}
+
+int SynEditStringList::firstUnscannedLine()
+{
+    QMutexLocker locker(&mMutex);
+    return mFirstUnscannedLine;
+}
+
+void SynEditStringList::setFirstUnscannedLine(int line)
+{
+    QMutexLocker locker(&mMutex);
+    mFirstUnscannedLine = line;
+}
+
+void SynEditStringList::ensureRangeScanned(int Index)
+{
+    if (Index >= mFirstUnscannedLine && mEdit)
+        mEdit->scanRangesTo(Index);
 }
 
 void SynEditStringList::invalidAllLineColumns()
 {
     QMutexLocker locker(&mMutex);
-    mIndexOfLongestLine = -1;
-    for (PSynEditStringRec& line:mList) {
-        line->fColumns = -1;
+    mMappedLongestLineColumns = -1;
+    for (int i=0;i<mList.count();i++) {
+        mList[i]->fColumns = -1;
     }
+    mLineColumnsCount.clear();
+    mUncountedLines = mList.count();
 }
 
 SynEditStringRec::SynEditStringRec():
     fString(),
     fObject(nullptr),
-    fRange{0,0,0,0,0},
-    fColumns(-1)
+    fRange(defaultRangeState()),
+    fMatchSerial(0),
+    fColumns(-1),
+    fFlags(SynEditStringFlag::sfExpandedLengthUnknown)
+{
+}
+
+SynEditLineExtra &SynEditStringRec::extra()
+{
+    if (!fExtra)
+        fExtra.reset(new SynEditLineExtra());
+    return *fExtra;
+}
+
+void SynEditStringRec::releaseExtraIfEmpty()
+{
+    if (fExtra && fExtra->isEmpty())
+        fExtra.reset();
+}
+
+SynEditLineExtra::SynEditLineExtra():
+    tokensQueued(false)
+{
+}
+
+bool SynEditLineExtra::isEmpty() const
+{
+    return !tokens && !tokensQueued && matches.isEmpty() && columnIndex.isEmpty();
+}
+
+
+SynEditStringRecList::SynEditStringRecList():
+    mCount(0),
+    mLastBlock(0)
+{
+}
+
+int SynEditStringRecList::count() const
+{
+    return mCount;
+}
+
+bool SynEditStringRecList::isEmpty() const
+{
+    return mCount == 0;
+}
+
+PSynEditStringRec &SynEditStringRecList::operator[](int index)
+{
+    int block = findBlock(index);
+    return mBlocks[block][index - mStarts[block]];
+}
+
+const PSynEditStringRec &SynEditStringRecList::operator[](int index) const
+{
+    int block = findBlock(index);
+    return mBlocks[block][index - mStarts[block]];
+}
+
+const PSynEditStringRec &SynEditStringRecList::back() const
+{
+    return mBlocks.last().last();
+}
+
+void SynEditStringRecList::append(const PSynEditStringRec &rec)
 {
+    //loading files appends line by line, so fill the last block and start a new one
+    //when it's full, instead of splitting
+    if (mBlocks.isEmpty() || mBlocks.last().count()>=BlockSize) {
+        mStarts.append(mCount);
+        mBlocks.append(QVector<PSynEditStringRec>());
+        mBlocks.last().reserve(BlockSize);
+    }
+    mBlocks.last().append(rec);
+    mCount++;
 }
 
+void SynEditStringRecList::insert(int index, const PSynEditStringRec &rec)
+{
+    insert(index,1,rec);
+}
+
+void SynEditStringRecList::insert(int index, int n, const PSynEditStringRec &rec)
+{
+    if (n<=0)
+        return;
+    if (mBlocks.isEmpty()) {
+        mBlocks.append(QVector<PSynEditStringRec>());
+        mStarts.append(0);
+    }
+    int block;
+    int offset;
+    if (index>=mCount) {
+        block = mBlocks.count()-1;
+        offset = mBlocks[block].count();
+    } else {
+        block = findBlock(index);
+        offset = index - mStarts[block];
+    }
+    mBlocks[block].insert(offset,n,rec);
+    mCount+=n;
+    if (mBlocks[block].count() > 2*BlockSize)
+        splitBlock(block);
+    else
+        updateStarts(block+1);
+}
+
+void SynEditStringRecList::remove(int index, int n)
+{
+    if (n<=0)
+        return;
+    int block = findBlock(index);
+    int offset = index - mStarts[block];
+    int b = block;
+    while (n>0 && b<mBlocks.count()) {
+        int k = std::min(n, mBlocks[b].count()-offset);
+        mBlocks[b].remove(offset,k);
+        n-=k;
+        mCount-=k;
+        offset = 0;
+        b++;
+    }
+    //blocks emptied by the removal are contiguous
+    int first = mBlocks[block].isEmpty()?block:block+1;
+    int last = first;
+    while (last<b && mBlocks[last].isEmpty())
+        last++;
+    if (last>first)
+        mBlocks.remove(first,last-first);
+    //merge with the next block when both are small, to keep the block count bounded
+    if (block+1<mBlocks.count()
+            && mBlocks[block].count()+mBlocks[block+1].count() <= BlockSize) {
+        mBlocks[block].append(mBlocks[block+1]);
+        mBlocks.remove(block+1);
+    }
+    updateStarts(block);
+}
+
+void SynEditStringRecList::removeAt(int index)
+{
+    remove(index,1);
+}
+
+void SynEditStringRecList::swapItemsAt(int index1, int index2)
+{
+    PSynEditStringRec rec = (*this)[index1];
+    (*this)[index1] = (*this)[index2];
+    (*this)[index2] = rec;
+}
+
+void SynEditStringRecList::clear()
+{
+    mBlocks.clear();
+    mStarts.clear();
+    mCount = 0;
+    mLastBlock = 0;
+}
+
+int SynEditStringRecList::findBlock(int index) const
+{
+    if (mLastBlock<mBlocks.count()) {
+        int start = mStarts[mLastBlock];
+        if (index>=start) {
+            if (index < start+mBlocks[mLastBlock].count())
+                return mLastBlock;
+            int next = mLastBlock+1;
+            if (next<mBlocks.count() && index < mStarts[next]+mBlocks[next].count()) {
+                mLastBlock = next;
+                return next;
+            }
+        }
+    }
+    auto it = std::upper_bound(mStarts.constBegin(),mStarts.constEnd(),index);
+    mLastBlock = std::max(0,int(it - mStarts.constBegin()) - 1);
+    return mLastBlock;
+}
+
+void SynEditStringRecList::splitBlock(int block)
+{
+    QVector<PSynEditStringRec> old = mBlocks[block];
+    QVector<QVector<PSynEditStringRec>> newBlocks = mBlocks.mid(0,block);
+    int pieces = (old.count()+BlockSize-1) / BlockSize;
+    newBlocks.reserve(mBlocks.count()+pieces-1);
+    for (int i=0;i<pieces;i++) {
+        newBlocks.append(old.mid(i*BlockSize,BlockSize));
+    }
+    newBlocks.append(mBlocks.mid(block+1));
+    mBlocks.swap(newBlocks);
+    updateStarts(block);
+}
+
+void SynEditStringRecList::updateStarts(int fromBlock)
+{
+    mStarts.resize(mBlocks.count());
+    for (int i=std::max(fromBlock,0);i<mBlocks.count();i++) {
+        mStarts[i] = (i==0)?0:mStarts[i-1]+mBlocks[i-1].count();
+    }
+}
+
+SynEditLineIndexThread::SynEditLineIndexThread(const QString& filename, const uchar *data, qint64 start, qint64 size, QObject *parent):
+    QThread(parent),
+    mFilename(filename),
+    mData(data),
+    mStart(start),
+    mSize(size),
+    mStop(false)
+{
+}
+
+void SynEditLineIndexThread::stop()
+{
+    mStop = true;
+}
+
+void SynEditLineIndexThread::run()
+{
+    QVector<qint64> lineStarts;
+    QElapsedTimer timer;
+    int longestLine = 0;
+    qint64 longestLineStart = mStart;
+    qint64 lineStart = mStart;
+    qint64 pos = mStart;
+    qint64 checkedEnd = mStart;
+    timer.start();
+    while (!mStop && pos < mSize) {
+        //the file may be truncated by another program, and reading the mapping past its end crashes,
+        //so the size is checked before scanning every MAPPED_FILE_CHECK_STEP bytes
+        if (pos >= checkedEnd) {
+            if (QFileInfo(mFilename).size() < mSize) {
+                emit fileShrunk();
+                return;
+            }
+            checkedEnd = std::min(mSize, pos + MAPPED_FILE_CHECK_STEP);
+        }
+        const uchar* p = static_cast<const uchar*>(memchr(mData+pos,'\n',checkedEnd-pos));
+        if (!p && checkedEnd < mSize) {
+            pos = checkedEnd;
+            continue;
+        }
+        qint64 next = p ? (p-mData)+1 : mSize;
+        lineStarts.append(lineStart);
+        int length = (int)std::min(next-lineStart,(qint64)INT_MAX);
+        if (length > longestLine) {
+            longestLine = length;
+            longestLineStart = lineStart;
+        }
+        lineStart = pos = next;
+        //report in batches, so the beginning of the file can be shown before it's all indexed
+        if (lineStarts.count()>=65536 || timer.elapsed()>=100) {
+            emit linesIndexed(lineStarts,pos,longestLine,longestLineStart);
+            lineStarts.clear();
+            timer.restart();
+        }
+    }
+    if (!mStop && !lineStarts.isEmpty())
+        emit linesIndexed(lineStarts,pos,longestLine,longestLineStart);
+}
 
 SynEditUndoList::SynEditUndoList():QObject()
 {
@@ -748,6 +1588,9 @@ SynEditUndoList::SynEditUndoList():QObject()
     mFullUndoImposible=false;
     mLockCount = 0;
     mInitialChangeNumber = 0;
+    mGroupUndo = false;
+    mMaxMemoryUsage = 64 * 1024 * 1024;
+    mMemoryUsage = 0;
 }
 
 void SynEditUndoList::AddChange(SynChangeReason AReason, const BufferCoord &AStart,
@@ -768,12 +1611,79 @@ void SynEditUndoList::AddChange(SynChangeReason AReason, const BufferCoord &ASta
             }
         }
     }
+    if (MergeChange(AReason,AStart,AEnd,ChangeText,SelMode,changeNumber)) {
+        emit addedUndo();
+        return;
+    }
     PSynEditUndoItem  NewItem = std::make_shared<SynEditUndoItem>(AReason,
                                                                   SelMode,AStart,AEnd,ChangeText,
                                                                   changeNumber);
     PushItem(NewItem);
 }
 
+bool SynEditUndoList::MergeChange(SynChangeReason AReason, const BufferCoord &AStart, const BufferCoord &AEnd, const QString &ChangeText, SynSelectionMode SelMode, int changeNumber)
+{
+    if (!mGroupUndo || mItems.isEmpty())
+        return false;
+    PSynEditUndoItem last = mItems.last();
+    if (last->changeReason() != AReason
+            || last->changeSelMode() != SynSelectionMode::smNormal
+            || SelMode != SynSelectionMode::smNormal)
+        return false;
+    //keep the saved state reachable by undo
+    if (last->changeNumber() == mInitialChangeNumber)
+        return false;
+    //don't take the item away from the other items of its block
+    if (mItems.count()>1 && mItems[mItems.count()-2]->changeNumber() == last->changeNumber())
+        return false;
+    //only changes of a few chars on a single line
+    if (AStart.Line != AEnd.Line || last->changeStartPos().Line != AStart.Line
+            || last->changeEndPos().Line != AStart.Line
+            || ChangeText.contains('\n') || ChangeText.contains('\r'))
+        return false;
+    BufferCoord start;
+    BufferCoord end;
+    QString text;
+    switch(AReason) {
+    case SynChangeReason::crInsert:
+        // typing
+        if (last->changeEndPos() != AStart || !ChangeText.isEmpty() || !last->changeStr().isEmpty())
+            return false;
+        start = last->changeStartPos();
+        end = AEnd;
+        break;
+    case SynChangeReason::crSilentDelete:
+        // backspace
+        if (last->changeStartPos() != AEnd)
+            return false;
+        start = AStart;
+        end = last->changeEndPos();
+        text = ChangeText + last->changeStr();
+        break;
+    case SynChangeReason::crSilentDeleteAfterCursor:
+        // delete
+        if (last->changeStartPos() != AStart)
+            return false;
+        start = AStart;
+        end = BufferCoord{last->changeEndPos().Char + AEnd.Char - AStart.Char, AStart.Line};
+        text = last->changeStr() + ChangeText;
+        break;
+    default:
+        return false;
+    }
+    mMemoryUsage -= itemMemoryUsage(last);
+    mItems.last() = std::make_shared<SynEditUndoItem>(AReason,
+                                                      SelMode,start,end,text,
+                                                      changeNumber);
+    mMemoryUsage += itemMemoryUsage(mItems.last());
+    return true;
+}
+
+int SynEditUndoList::itemMemoryUsage(const PSynEditUndoItem &item)
+{
+    return sizeof(SynEditUndoItem) + item->changeStr().size() * sizeof(QChar);
+}
+
 void SynEditUndoList::AddGroupBreak()
 {
     //Add the GroupBreak even if ItemCount = 0. Since items are stored in
@@ -792,6 +1702,7 @@ void SynEditUndoList::BeginBlock()
 void SynEditUndoList::Clear()
 {
     mItems.clear();
+    mMemoryUsage = 0;
     mFullUndoImposible = false;
 }
 
@@ -800,6 +1711,7 @@ void SynEditUndoList::DeleteItem(int index)
     if (index <0 || index>=mItems.count()) {
         ListIndexOutOfBounds(index);
     }
+    mMemoryUsage -= itemMemoryUsage(mItems[index]);
     mItems.removeAt(index);
 }
 
@@ -847,6 +1759,7 @@ PSynEditUndoItem SynEditUndoList::PopItem()
     else {
         PSynEditUndoItem item = mItems.last();
         mItems.removeLast();
+        mMemoryUsage -= itemMemoryUsage(item);
         return item;
     }
 }
@@ -856,6 +1769,7 @@ void SynEditUndoList::PushItem(PSynEditUndoItem Item)
     if (!Item)
         return;
     mItems.append(Item);
+    mMemoryUsage += itemMemoryUsage(Item);
     EnsureMaxEntries();
     if (Item->changeReason()!= SynChangeReason::crGroupBreak)
         emit addedUndo();
@@ -925,7 +1839,9 @@ void SynEditUndoList::setItem(int index, PSynEditUndoItem Value)
     if (index <0 || index>=mItems.count()) {
         ListIndexOutOfBounds(index);
     }
+    mMemoryUsage -= itemMemoryUsage(mItems[index]);
     mItems[index]=Value;
+    mMemoryUsage += itemMemoryUsage(Value);
 }
 
 int SynEditUndoList::blockChangeNumber() const
@@ -958,13 +1874,35 @@ bool SynEditUndoList::fullUndoImposible() const
     return mFullUndoImposible;
 }
 
+bool SynEditUndoList::groupUndo() const
+{
+    return mGroupUndo;
+}
+
+void SynEditUndoList::setGroupUndo(bool groupUndo)
+{
+    mGroupUndo = groupUndo;
+}
+
+int SynEditUndoList::maxMemoryUsage() const
+{
+    return mMaxMemoryUsage;
+}
+
+void SynEditUndoList::setMaxMemoryUsage(int maxMemoryUsage)
+{
+    mMaxMemoryUsage = maxMemoryUsage;
+    EnsureMaxEntries();
+}
+
 void SynEditUndoList::EnsureMaxEntries()
 {
-    if (mItems.count() > mMaxUndoActions){
+    //always keep the last item, even if it's bigger than the memory limit
+    while (mItems.count() > 1
+           && (mItems.count() > mMaxUndoActions || mMemoryUsage > mMaxMemoryUsage)) {
         mFullUndoImposible = true;
-        while (mItems.count() > mMaxUndoActions) {
-            mItems.removeFirst();
-      }
+        mMemoryUsage -= itemMemoryUsage(mItems.first());
+        mItems.removeFirst();
     }
 }
 
@@ -21,7 +21,12 @@
 #include "highlighter/base.h"
 #include <QMutex>
 #include <QVector>
+#include <QHash>
+#include <QMap>
+#include <QQueue>
+#include <QThread>
 #include <memory>
+#include <atomic>
 #include "MiscProcs.h"
 #include "../utils.h"
 #include "Types.h"
@@ -29,24 +34,132 @@
 enum SynEditStringFlag {
     sfHasTabs = 0x0001,
     sfHasNoTabs = 0x0002,
-    sfExpandedLengthUnknown = 0x0004
+    sfExpandedLengthUnknown = 0x0004,
+    sfSingleWidth = 0x0008 // no tabs and every char takes one column
 };
 
 typedef int SynEditStringFlags;
 
+/*
+ * Range states are immutable and interned by SynEditStringList, so lines with
+ * the same state share one object, and two states are equal iff their pointers are.
+ */
+typedef std::shared_ptr<const SynRangeState> PSynRangeState;
+
+/*
+ * A token found by the highlighter in a line.
+ * level is the total of brace/bracket/parenthesis levels after the token, only set for braces.
+ */
+struct SynEditLineToken {
+    int pos;
+    int length;
+    PSynHighlighterAttribute attr;
+    SynTokenKind kind;
+    SynHighlighterTokenType type;
+    bool finished;
+    int level;
+};
+
+/*
+ * Tokens of a line, highlighted starting from startRange (the range of the previous line,
+ * nullptr for the first line). They are valid while the line is not changed and
+ * the previous line's range is still startRange.
+ */
+struct SynEditLineTokens {
+    PSynRangeState startRange;
+    QVector<SynEditLineToken> tokens;
+};
+
+typedef std::shared_ptr<SynEditLineTokens> PSynEditLineTokens;
+
+/*
+ * A highlighted match in a line, start is 0-based.
+ */
+struct SynEditLineMatch {
+    int start;
+    int length;
+};
+
+/*
+ * Line data most lines don't have, it's only allocated for the lines that have some.
+ */
+struct SynEditLineExtra {
+  PSynEditLineTokens tokens;
+  // highlighted matches in the line, if it has some
+  QVector<SynEditLineMatch> matches;
+  // columns before every ColumnIndexStep-th char, only kept for lines that aren't sfSingleWidth
+  QVector<int> columnIndex;
+  // the line is in the queue of the lines with cached tokens
+  bool tokensQueued;
+
+public:
+  explicit SynEditLineExtra();
+  bool isEmpty() const;
+};
+
 struct SynEditStringRec {
   QString fString;
   void * fObject;
-  SynRangeState fRange;
+  PSynRangeState fRange;
+  // serial of the pattern the line was last searched for, 0 if it's not searched yet
+  int fMatchSerial;
   int fColumns;  //
+  SynEditStringFlags fFlags;
+  std::unique_ptr<SynEditLineExtra> fExtra;
 
 public:
   explicit SynEditStringRec();
+  SynEditLineExtra& extra();
+  void releaseExtraIfEmpty();
 };
 
 typedef std::shared_ptr<SynEditStringRec> PSynEditStringRec;
 
-typedef QVector<PSynEditStringRec> SynEditStringRecList;
+/*
+ * Line records are kept in blocks of (at most 2*BlockSize) lines, so inserting or
+ * deleting lines in the middle of a big file only moves the records of the blocks
+ * touched by the change, instead of the whole line array.
+ * Locating a line is a binary search on the block starts; sequential accesses
+ * hit the cached block and are O(1).
+ *
+ * It's a blocked list of line records, not a piece table or rope:
+ * - inserting or deleting lines is O(n/BlockSize + BlockSize), because the starts of
+ *   the following blocks are updated;
+ * - every line is still one record with its own QString.
+ * The editor, the highlighter and the undo list all work on per-line records
+ * (ranges, flags, cached tokens), so a byte based storage would have to rebuild them
+ * for every access. With BlockSize 512 the block starts of a 1M lines file are 2K ints,
+ * which keeps mid-file edits fast enough without changing the line model.
+ */
+class SynEditStringRecList {
+public:
+    static const int BlockSize = 512;
+
+    explicit SynEditStringRecList();
+
+    int count() const;
+    bool isEmpty() const;
+    PSynEditStringRec& operator[](int index);
+    const PSynEditStringRec& operator[](int index) const;
+    const PSynEditStringRec& back() const;
+
+    void append(const PSynEditStringRec& rec);
+    void insert(int index, const PSynEditStringRec& rec);
+    void insert(int index, int n, const PSynEditStringRec& rec);
+    void remove(int index, int n);
+    void removeAt(int index);
+    void swapItemsAt(int index1, int index2);
+    void clear();
+private:
+    int findBlock(int index) const;
+    void splitBlock(int block);
+    void updateStarts(int fromBlock);
+private:
+    QVector<QVector<PSynEditStringRec>> mBlocks;
+    QVector<int> mStarts;
+    int mCount;
+    mutable int mLastBlock;
+};
 
 typedef std::shared_ptr<SynEditStringRecList> PSynEditStringRecList;
 
@@ -57,6 +170,30 @@ typedef std::shared_ptr<SynEditStringList> PSynEditStringList;
 using StringListChangeCallback = std::function<void(PSynEditStringList* object, int index, int count)>;
 
 class QFile;
+class QTextCodec;
+
+/*
+ * Scans a memory mapped file for the start of each line in background,
+ * and reports them in batches.
+ */
+class SynEditLineIndexThread : public QThread {
+    Q_OBJECT
+public:
+    explicit SynEditLineIndexThread(const QString& filename, const uchar* data, qint64 start, qint64 size, QObject* parent=nullptr);
+    void stop();
+signals:
+    // longestLine is the byte length of the longest line indexed so far, which starts at longestLineStart
+    void linesIndexed(const QVector<qint64>& lineStarts, qint64 indexedEnd, int longestLine, qint64 longestLineStart);
+    void fileShrunk();
+protected:
+    void run() override;
+private:
+    QString mFilename;
+    const uchar* mData;
+    qint64 mStart;
+    qint64 mSize;
+    std::atomic<bool> mStop;
+};
 
 class SynEdit;
 class SynEditStringList : public QObject
@@ -64,17 +201,40 @@ class SynEditStringList : public QObject
     Q_OBJECT
 public:
     explicit SynEditStringList(SynEdit* pEdit,QObject* parent=nullptr);
+    ~SynEditStringList();
 
     int parenthesisLevels(int Index);
     int bracketLevels(int Index);
     int braceLevels(int Index);
     int lineColumns(int Index);
+    /*
+     * Columns taken by the first CharCount chars of the line, and
+     * 0-based index of the char which ends at or after Column (or the line length).
+     * Both use the line's column index instead of walking the whole line.
+     */
+    int charsColumns(int Index, int CharCount);
+    int columnToCharIndex(int Index, int Column);
     int leftBraces(int Index);
     int rightBraces(int Index);
     int lengthOfLongestLine();
     QString lineBreak() const;
     SynRangeState ranges(int Index);
+    PSynRangeState rangeHandle(int Index);
+    PSynRangeState internRange(const SynRangeState& ARange);
     void setRange(int Index, const SynRangeState& ARange);
+    void setRange(int Index, const PSynRangeState& ARange);
+    /*
+     * Cached highlighter tokens of the line, or nullptr if they are not cached or not valid anymore.
+     */
+    PSynEditLineTokens lineTokens(int Index);
+    void setLineTokens(int Index, const PSynEditLineTokens& tokens);
+    void clearLineTokens();
+    /*
+     * Highlighted matches of the line, returns false if the line is not searched
+     * for the pattern with the serial yet.
+     */
+    bool lineMatches(int Index, int serial, QVector<SynEditLineMatch>& matches);
+    void setLineMatches(int Index, int serial, const QVector<SynEditLineMatch>& matches);
     QString getString(int Index);
     int count();
     void* getObject(int Index);
@@ -102,6 +262,13 @@ public:
     void insertStrings(int Index, const QStringList& NewStrings);
     void insertText(int Index,const QString& NewText);
     void loadFromFile(const QString& filename, const QByteArray& encoding, QByteArray& realEncoding);
+    /*
+     * Memory maps the file instead of loading it. Lines are indexed in background
+     * and only decoded when they are asked for. The contents can't be modified
+     * and no highlighting ranges are kept.
+     */
+    void loadFromMappedFile(const QString& filename, const QByteArray& encoding, QByteArray& realEncoding);
+    bool mapped();
     void saveToFile(QFile& file, const QByteArray& encoding,
                     const QByteArray& defaultEncoding, QByteArray& realEncoding);
 
@@ -114,10 +281,21 @@ public:
     bool empty();
 
     void resetColumns();
+
+    /*
+     * Ranges of lines from firstUnscannedLine() on are not computed yet.
+     * They are scanned by the editor when asked for, or in idle time.
+     */
+    int firstUnscannedLine();
+    void setFirstUnscannedLine(int line);
 public slots:
     void invalidAllLineColumns();
+private slots:
+    void onMappedLinesIndexed(const QVector<qint64>& lineStarts, qint64 indexedEnd, int longestLine, qint64 longestLineStart);
 
 signals:
+    // the mapped file is truncated by another program, the buffer should be reloaded
+    void mappedFileShrunk();
     void changed();
     void changing();
     void cleared();
@@ -131,20 +309,52 @@ protected:
     void addItem(const QString& s);
     void putTextStr(const QString& text);
     void internalClear();
+    QString getMappedString(int Index, bool checkSize=true) const;
+    bool checkMappedSize(qint64 end) const;
+    void releaseMappedFile();
+    void saveMappedToFile(QFile& file, QByteArray& realEncoding);
+    void ensureRangeScanned(int Index);
 
 private:
     SynEditStringRecList mList;
+    std::shared_ptr<QFile> mMappedFile;
+    uchar* mMappedData;
+    qint64 mMappedSize;
+    QVector<qint64> mMappedLineStarts;
+    qint64 mMappedIndexedEnd;
+    int mMappedLongestLine; // in bytes
+    int mMappedLongestLineIndex;
+    int mMappedLongestLineColumns; // columns of the line with the most bytes, -1 if not computed
+    mutable bool mMappedFileShrunk;
+    QTextCodec* mMappedCodec;
+    SynEditLineIndexThread* mIndexThread;
 
     SynEdit* mEdit;
     //int mCount;
     //int mCapacity;
     FileEndingType mFileEndingType;
     bool mAppendNewLineAtEOF;
-    int mIndexOfLongestLine;
+    //number of lines having each column count, the longest line is the last key
+    QMap<int,int> mLineColumnsCount;
+    //lines whose columns are not computed (and counted) yet
+    int mUncountedLines;
+    int mFirstUnscannedLine;
+    QHash<uint,QVector<PSynRangeState>> mRangePool;
+    int mRangePoolSize;
+    int mRangePoolPurgeSize;
+    //lines with cached tokens, the oldest first; the tokens of the oldest ones are dropped
+    //when there are more than MaxTokenCachedLines (entries of deleted lines just expire)
+    QQueue<std::weak_ptr<SynEditStringRec>> mTokenCachedLines;
     int mUpdateCount;
     QRecursiveMutex mMutex;
 
     int calculateLineColumns(int Index);
+    void updateLineColumns(int Index);
+    void ensureLineColumns(int Index);
+    void countLineColumns(int columns, int delta);
+public:
+    static const int ColumnIndexStep = 64;
+    static const int MaxTokenCachedLines = 4096;
 };
 
 enum class SynChangeReason {crInsert, crPaste, crDragDropInsert,
@@ -228,17 +438,35 @@ public:
 
     bool fullUndoImposible() const;
 
+    /*
+     * When set, typing, backspacing or deleting chars one after another on a line
+     * is merged into the last item, instead of adding an item per char.
+     */
+    bool groupUndo() const;
+    void setGroupUndo(bool groupUndo);
+
+    //memory (in bytes) the items can use, before the oldest ones are dropped
+    int maxMemoryUsage() const;
+    void setMaxMemoryUsage(int maxMemoryUsage);
+
 signals:
     void addedUndo();
 protected:
     void EnsureMaxEntries();
+    bool MergeChange(SynChangeReason AReason, const BufferCoord& AStart, const BufferCoord& AEnd,
+                     const QString& ChangeText, SynSelectionMode SelMode, int changeNumber);
+    static int itemMemoryUsage(const PSynEditUndoItem& item);
 protected:
     int mBlockChangeNumber;
     int mBlockCount;
     bool mFullUndoImposible;
-    QVector<PSynEditUndoItem> mItems;
+    //QList, so the oldest items are removed in O(1)
+    QList<PSynEditUndoItem> mItems;
     int mLockCount;
     int mMaxUndoActions;
+    bool mGroupUndo;
+    int mMaxMemoryUsage;
+    int mMemoryUsage;
     int mNextChangeNumber;
     int mInitialChangeNumber;
     bool mInsideRedo;
@@ -600,11 +600,45 @@ bool SynEditTextPainter::TokenIsSpaces(bool &bSpacesTest, const QString& Token,
     return bIsSpaces;
 }
 
+// Split the token where the highlighted matches of the line begin or end.
+void SynEditTextPainter::AddHighlightToken(const QString &Token, int ColumnsBefore,
+                                           int TokenColumns, int cLine, int cChar, PSynHighlighterAttribute p_Attri)
+{
+    int tokenStart = cChar - 1;
+    int tokenEnd = tokenStart + Token.length();
+    int pos = tokenStart;
+    auto addPart = [&](int partEnd, bool bMatched) {
+        if (TokenColumns <= 0)
+            return;
+        QString part = Token.mid(pos - tokenStart, partEnd - pos);
+        int partColumns = edit->stringColumns(part, ColumnsBefore);
+        if (partEnd >= tokenEnd || partColumns > TokenColumns)
+            partColumns = TokenColumns;
+        AddHighlightTokenPart(part, ColumnsBefore, partColumns, cLine, pos + 1, p_Attri, bMatched);
+        ColumnsBefore += partColumns;
+        TokenColumns -= partColumns;
+        pos = partEnd;
+    };
+    for (const SynEditLineMatch& match:lineMatches) {
+        if (match.start + match.length <= pos)
+            continue;
+        if (match.start >= tokenEnd)
+            break;
+        if (match.start > pos)
+            addPart(match.start, false);
+        addPart(std::min(tokenEnd, match.start + match.length), true);
+    }
+    if (pos == tokenStart)
+        AddHighlightTokenPart(Token, ColumnsBefore, TokenColumns, cLine, cChar, p_Attri, false);
+    else if (pos < tokenEnd)
+        addPart(tokenEnd, false);
+}
+
 // Store the token chars with the attributes in the TokenAccu
 // record. This will paint any chars already stored if there is
 // a (visible) change in the attributes.
-void SynEditTextPainter::AddHighlightToken(const QString &Token, int ColumnsBefore,
-                                           int TokenColumns, int cLine, PSynHighlighterAttribute p_Attri)
+void SynEditTextPainter::AddHighlightTokenPart(const QString &Token, int ColumnsBefore,
+                                           int TokenColumns, int cLine, int cChar, PSynHighlighterAttribute p_Attri, bool bMatched)
 {
     bool bCanAppend;
     QColor Foreground, Background;
@@ -631,8 +665,14 @@ void SynEditTextPainter::AddHighlightToken(const QString &Token, int ColumnsBefo
         Foreground = edit->mForegroundColor;
     }
 
-    edit->onPreparePaintHighlightToken(cLine,edit->mHighlighter->getTokenPos()+1,
+    edit->onPreparePaintHighlightToken(cLine,cChar,
         Token,p_Attri,Style,Foreground,Background);
+    if (bMatched) {
+        if (edit->mMatchForeground.isValid())
+            Foreground = edit->mMatchForeground;
+        if (edit->mMatchBackground.isValid())
+            Background = edit->mMatchBackground;
+    }
 
     // Do we have to paint the old chars first, or can we just append?
     bCanAppend = false;
@@ -931,69 +971,61 @@ void SynEditTextPainter::PaintLines()
                   PaintEditAreas(areaList);
               }
         } else {
-            // Initialize highlighter with line text and range info. It is
-            // necessary because we probably did not scan to the end of the last
-            // line - the internal highlighter range might be wrong.
-            if (vLine == 1) {
-                edit->mHighlighter->resetState();
+            // Get the tokens of the line. They are highlighted when the line's
+            // range is scanned, so normally repaints don't need to lex the line.
+            // The line with the input method's preedit text is not cached.
+            bool bPreedit = bCurrentLine && edit->mInputPreeditString.length()>0;
+            PSynEditLineTokens lineTokens;
+            if (bPreedit) {
+                lineTokens = edit->tokenizeLine(sLine, vLine - 1);
+                lineMatches.clear();
             } else {
-                edit->mHighlighter->setState(
-                            edit->mLines->ranges(vLine-2));
+                lineTokens = edit->lineTokens(vLine - 1);
+                lineMatches = edit->lineMatches(vLine - 1);
             }
-            edit->mHighlighter->setLine(sLine, vLine - 1);
             // Try to concatenate as many tokens as possible to minimize the count
             // of ExtTextOut calls necessary. This depends on the selection state
             // or the line having special colors. For spaces the foreground color
             // is ignored as well.
             TokenAccu.Columns = 0;
             nTokenColumnsBefore = 0;
+            int nTokenEnd = 0;
+            bool bLineEnd = true;
+            sToken = "";
             // Test first whether anything of this token is visible.
-            while (!edit->mHighlighter->eol()) {
-                sToken = edit->mHighlighter->getToken();
-                // Work-around buggy highlighters which return empty tokens.
-                if (sToken.isEmpty())  {
-                    edit->mHighlighter->next();
-                    if (edit->mHighlighter->eol())
-                        break;
-                    sToken = edit->mHighlighter->getToken();
-                    // Maybe should also test whether GetTokenPos changed...
-                    if (sToken.isEmpty()) {
-                        qDebug()<<SynEdit::tr("The highlighter seems to be in an infinite loop");
-                        throw BaseError(SynEdit::tr("The highlighter seems to be in an infinite loop"));
-                    }
-                }
-                nTokenColumnsBefore = edit->charToColumn(sLine,edit->mHighlighter->getTokenPos()+1)-1;
+            for (const SynEditLineToken& token:lineTokens->tokens) {
+                sToken = sLine.mid(token.pos,token.length);
+                if (bPreedit)
+                    nTokenColumnsBefore = edit->charToColumn(sLine,token.pos+1)-1;
+                else
+                    nTokenColumnsBefore = edit->charToColumn(vLine,token.pos+1)-1;
                 nTokenColumnLen = edit->stringColumns(sToken, nTokenColumnsBefore);
+                nTokenEnd = token.pos + token.length;
                 if (nTokenColumnsBefore + nTokenColumnLen >= vFirstChar) {
                     if (nTokenColumnsBefore + nTokenColumnLen >= vLastChar) {
-                        if (nTokenColumnsBefore >= vLastChar)
+                        if (nTokenColumnsBefore >= vLastChar) {
+                            bLineEnd = false;
                             break; //*** BREAK ***
+                        }
                         nTokenColumnLen = vLastChar - nTokenColumnsBefore - 1;
                     }
                     // It's at least partially visible. Get the token attributes now.
-                    attr = edit->mHighlighter->getTokenAttribute();
+                    attr = token.attr;
                     if (sToken == "["
                             || sToken == "("
                             || sToken == "{"
                             ) {
-                        SynRangeState rangeState = edit->mHighlighter->getRangeState();
-                        GetBraceColorAttr(rangeState.bracketLevel
-                                          +rangeState.braceLevel
-                                          +rangeState.parenthesisLevel
-                                          ,attr);
+                        GetBraceColorAttr(token.level,attr);
                     } else if (sToken == "]"
                                || sToken == ")"
                                || sToken == "}"
                                ){
-                        SynRangeState rangeState = edit->mHighlighter->getRangeState();
-                        GetBraceColorAttr(rangeState.bracketLevel
-                                          +rangeState.braceLevel
-                                          +rangeState.parenthesisLevel+1,
+                        GetBraceColorAttr(token.level+1,
                                           attr);
                     }
-                    if (bCurrentLine && edit->mInputPreeditString.length()>0) {
-                        int startPos = edit->mHighlighter->getTokenPos()+1;
-                        int endPos = edit->mHighlighter->getTokenPos() + sToken.length();
+                    if (bPreedit) {
+                        int startPos = token.pos+1;
+                        int endPos = token.pos + sToken.length();
                         //qDebug()<<startPos<<":"<<endPos<<" - "+sToken+" - "<<edit->mCaretX<<":"<<edit->mCaretX+edit->mInputPreeditString.length();
                         if (!(endPos < edit->mCaretX
                                 || startPos >= edit->mCaretX+edit->mInputPreeditString.length())) {
@@ -1005,14 +1037,12 @@ void SynEditTextPainter::PaintLines()
                         }
                     }
                     AddHighlightToken(sToken, nTokenColumnsBefore - (vFirstChar - FirstCol),
-                      nTokenColumnLen, vLine,attr);
+                      nTokenColumnLen, vLine, token.pos+1, attr);
                 }
-                // Let the highlighter scan the next token.
-                edit->mHighlighter->next();
             }
             // Don't assume HL.GetTokenPos is valid after HL.GetEOL == True.
             nTokenColumnsBefore += edit->stringColumns(sToken,nTokenColumnsBefore);
-            if (edit->mHighlighter->eol() && (nTokenColumnsBefore < vLastChar)) {
+            if (bLineEnd && (nTokenColumnsBefore < vLastChar)) {
                 int lineColumns = edit->mLines->lineColumns(vLine-1);
                 // Draw text that couldn't be parsed by the highlighter, if any.
                 if (nTokenColumnsBefore < lineColumns) {
@@ -1022,7 +1052,7 @@ void SynEditTextPainter::PaintLines()
                     if (nTokenColumnLen > 0) {
                         sToken = edit->substringByColumns(sLine,nTokenColumnsBefore+1,nTokenColumnLen);
                         AddHighlightToken(sToken, nTokenColumnsBefore - (vFirstChar - FirstCol),
-                            nTokenColumnLen, vLine, PSynHighlighterAttribute());
+                            nTokenColumnLen, vLine, nTokenEnd+1, PSynHighlighterAttribute());
                     }
                 }
                 // Draw LineBreak glyph.
@@ -1030,7 +1060,7 @@ void SynEditTextPainter::PaintLines()
                     (!bSpecialLine) && (edit->mLines->lineColumns(vLine-1) < vLastChar)) {
                     AddHighlightToken(SynLineBreakGlyph,
                       edit->mLines->lineColumns(vLine-1)  - (vFirstChar - FirstCol),
-                      edit->charColumns(SynLineBreakGlyph),vLine, edit->mHighlighter->whitespaceAttribute());
+                      edit->charColumns(SynLineBreakGlyph),vLine, nTokenEnd+1, edit->mHighlighter->whitespaceAttribute());
                 }
             }
 
@@ -1040,9 +1070,9 @@ void SynEditTextPainter::PaintLines()
                 sFold = " ... } ";
                 nFold = edit->stringColumns(sFold,edit->mLines->lineColumns(vLine-1));
                 attr = edit->mHighlighter->symbolAttribute();
-                GetBraceColorAttr(edit->mHighlighter->getRangeState().braceLevel,attr);
+                GetBraceColorAttr(edit->mLines->braceLevels(vLine-1),attr);
                 AddHighlightToken(sFold,edit->mLines->lineColumns(vLine-1)+1 - (vFirstChar - FirstCol)
-                  , nFold, vLine, attr);
+                  , nFold, vLine, nTokenEnd+1, attr);
             }
 
             // Draw anything that's left in the TokenAccu record. Fill to the end
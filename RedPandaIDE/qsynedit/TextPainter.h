@@ -24,6 +24,7 @@
 #include "highlighter/base.h"
 #include "../utils.h"
 #include "MiscClasses.h"
+#include "TextBuffer.h"
 
 class SynEdit;
 class SynEditTextPainter
@@ -54,7 +55,9 @@ private:
     void PaintHighlightToken(bool bFillToEOL);
     bool TokenIsSpaces(bool& bSpacesTest, const QString& Token, bool& bIsSpaces);
     void AddHighlightToken(const QString& Token, int ColumnsBefore, int TokenColumns,
-                           int cLine, PSynHighlighterAttribute p_Attri);
+                           int cLine, int cChar, PSynHighlighterAttribute p_Attri);
+    void AddHighlightTokenPart(const QString& Token, int ColumnsBefore, int TokenColumns,
+                           int cLine, int cChar, PSynHighlighterAttribute p_Attri, bool bMatched);
 
     void PaintFoldAttributes();
     void GetBraceColorAttr(int level, PSynHighlighterAttribute &attr);
@@ -75,6 +78,8 @@ private:
     QColor colFG, colBG;
     QColor colSelFG, colSelBG;
     QColor colSpFG, colSpBG;
+    // highlighted matches of the current line
+    QVector<SynEditLineMatch> lineMatches;
     // info about selection of the current line
     int nLineSelStart, nLineSelEnd;
     bool bComplexLine;
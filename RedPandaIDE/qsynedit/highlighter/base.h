@@ -40,6 +40,8 @@ struct SynRangeState {
     int parenthesisLevel; // current parenthesis embedding level (needed by rainbow color)
     int leftBraces; // unpairing left braces in the current line ( needed by block folding)
     int rightBraces; // unparing right braces in the current line (needed by block folding)
+    int minBracketLevel; // lowest brackets embedding level in the current line (needed by bracket matching)
+    int minParenthesisLevel; // lowest parenthesis embedding level in the current line (needed by bracket matching)
     QVector<int> indents; // indents stack (needed by auto indent)
     int firstIndentThisLine; /* index of first indent that appended to the indents
                               *  stack at this line ( need by auto indent) */
@@ -18,6 +18,7 @@
 #include "../Constants.h"
 
 #include <QFont>
+#include <algorithm>
 
 static const QSet<QString> StatementKeyWords {
     "if",
@@ -908,6 +909,7 @@ void SynEditCppHighlighter::roundCloseProc()
     mTokenId = TokenKind::Symbol;
     mExtTokenId = ExtTokenKind::RoundClose;
     mRange.parenthesisLevel--;
+    mRange.minParenthesisLevel = std::min(mRange.minParenthesisLevel, mRange.parenthesisLevel);
     popIndents(sitParenthesis);
 }
 
@@ -982,6 +984,7 @@ void SynEditCppHighlighter::squareCloseProc()
     mTokenId = TokenKind::Symbol;
     mExtTokenId = ExtTokenKind::SquareClose;
     mRange.bracketLevel--;
+    mRange.minBracketLevel = std::min(mRange.minBracketLevel, mRange.bracketLevel);
     popIndents(sitBracket);
 }
 
@@ -1518,6 +1521,8 @@ void SynEditCppHighlighter::setLine(const QString &newLine, int lineNumber)
     mRun = 0;
     mRange.leftBraces = 0;
     mRange.rightBraces = 0;
+    mRange.minBracketLevel = mRange.bracketLevel;
+    mRange.minParenthesisLevel = mRange.parenthesisLevel;
     mRange.firstIndentThisLine = mRange.indents.length();
     mRange.matchingIndents.clear();
     next();
@@ -1586,6 +1591,8 @@ void SynEditCppHighlighter::setState(const SynRangeState& rangeState)
     // current line's left / right parenthesis count should be reset before parsing each line
     mRange.leftBraces = 0;
     mRange.rightBraces = 0;
+    mRange.minBracketLevel = mRange.bracketLevel;
+    mRange.minParenthesisLevel = mRange.parenthesisLevel;
     mRange.firstIndentThisLine = mRange.indents.length();
     mRange.matchingIndents.clear();
 }
@@ -1598,6 +1605,8 @@ void SynEditCppHighlighter::resetState()
     mRange.parenthesisLevel = 0;
     mRange.leftBraces = 0;
     mRange.rightBraces = 0;
+    mRange.minBracketLevel = 0;
+    mRange.minParenthesisLevel = 0;
     mRange.indents.clear();
     mRange.firstIndentThisLine = 0;
     mRange.matchingIndents.clear();
@@ -26,6 +26,10 @@
 #include <QStandardPaths>
 #include <QScreen>
 #include <QDesktopWidget>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSaveFile>
+#include "parser/cpppreprocessor.h"
 
 const char ValueToChar[28] = {'0', '1', 'a', 'b', 'c', 'd', 'e', 'f', 'g', 'h',
                               'i', 'j', 'k', 'l', 'm', 'n', 'o', 'p', 'q', 'r',
@@ -1366,9 +1370,10 @@ void Settings::Editor::setTabToSpaces(bool tabToSpaces)
     mTabToSpaces = tabToSpaces;
 }
 
-Settings::CompilerSet::CompilerSet(const QString& compilerFolder):
+Settings::CompilerSet::CompilerSet(const QString& compilerFolder, CompilerOutputCache* outputCache):
     mAutoAddCharsetParams(true),
-    mStaticLink(true)
+    mStaticLink(true),
+    mOutputCache(outputCache)
 {
     if (!compilerFolder.isEmpty()) {
         setProperties(compilerFolder);
@@ -1401,13 +1406,15 @@ Settings::CompilerSet::CompilerSet(const Settings::CompilerSet &set):
     mType(set.mType),
     mName(set.mName),
     mDefines(set.mDefines),
+    mParsedDefines(set.mParsedDefines),
     mTarget(set.mTarget),
     mCompilerType(set.mCompilerType),
     mUseCustomCompileParams(set.mUseCustomCompileParams),
     mUseCustomLinkParams(set.mUseCustomLinkParams),
     mCustomCompileParams(set.mCustomCompileParams),
     mCustomLinkParams(set.mCustomLinkParams),
-    mAutoAddCharsetParams(set.mAutoAddCharsetParams)
+    mAutoAddCharsetParams(set.mAutoAddCharsetParams),
+    mOutputCache(set.mOutputCache)
 {
     // Executables, most are hardcoded
     for (PCompilerOption pOption:set.mOptions) {
@@ -1735,6 +1742,22 @@ const QStringList& Settings::CompilerSet::defines() const
     return mDefines;
 }
 
+PDefineMap Settings::CompilerSet::parsedDefines()
+{
+    if (!mParsedDefines) {
+        CppPreprocessor preprocessor;
+        for (const QString& define:mDefines) {
+            // predefined constants from -dM -E
+            if (define.startsWith('#'))
+                preprocessor.addHardDefineByLine(define.mid(1).trimmed());
+            else
+                preprocessor.addHardDefineByLine(define);
+        }
+        mParsedDefines = std::make_shared<DefineMap>(preprocessor.hardDefines());
+    }
+    return mParsedDefines;
+}
+
 const QString &Settings::CompilerSet::target() const
 {
     return mTarget;
@@ -1933,6 +1956,7 @@ void Settings::CompilerSet::setDefines() {
     // 'cpp.exe -dM -E -x c++ -std=c++17 NUL'
 
     mDefines.clear();
+    mParsedDefines.reset();
     QList<QByteArray> lines = output.split('\n');
     for (QByteArray& line:lines) {
         QByteArray trimmedLine = line.trimmed();
@@ -2276,6 +2300,8 @@ void Settings::CompilerSet::setIniOptions(const QByteArray &value)
 
 QByteArray Settings::CompilerSet::getCompilerOutput(const QString &binDir, const QString &binFile, const QStringList &arguments)
 {
+    if (mOutputCache)
+        return mOutputCache->getOutput(binDir,binFile,arguments);
     QProcessEnvironment env;
     env.insert("LANG","en");
     QByteArray result = runAndGetOutput(
@@ -2288,6 +2314,88 @@ QByteArray Settings::CompilerSet::getCompilerOutput(const QString &binDir, const
     return result.trimmed();
 }
 
+Settings::CompilerOutputCache::CompilerOutputCache(const QString &filename):
+    mFilename(filename),
+    mChanged(false)
+{
+    load();
+}
+
+QByteArray Settings::CompilerOutputCache::getOutput(const QString &binDir, const QString &binFile, const QStringList &arguments)
+{
+    QFileInfo fileInfo(includeTrailingPathDelimiter(binDir)+binFile);
+    QString key = fileInfo.absoluteFilePath() + " " + arguments.join(" ");
+    QString size = QString::number(fileInfo.size());
+    QString modified = QString::number(fileInfo.lastModified().toMSecsSinceEpoch());
+    QJsonObject entry = mCache.value(key).toObject();
+    if (!entry.isEmpty()
+            && entry["size"].toString() == size
+            && entry["modified"].toString() == modified) {
+        return QByteArray::fromBase64(entry["output"].toString().toLatin1());
+    }
+
+    QProcessEnvironment env;
+    env.insert("LANG","en");
+    QByteArray result = runAndGetOutput(
+                includeTrailingPathDelimiter(binDir)+binFile,
+                binDir,
+                arguments,
+                QByteArray(),
+                false,
+                env);
+    result = result.trimmed();
+    if (fileInfo.exists()) {
+        entry = QJsonObject();
+        entry["file"] = fileInfo.absoluteFilePath();
+        entry["size"] = size;
+        entry["modified"] = modified;
+        entry["output"] = QString::fromLatin1(result.toBase64());
+        mCache[key] = entry;
+        mChanged = true;
+    }
+    return result;
+}
+
+void Settings::CompilerOutputCache::save()
+{
+    if (!mChanged || mFilename.isEmpty())
+        return;
+    // the old cache is kept if we crash while writing
+    QSaveFile file(mFilename);
+    if (!file.open(QFile::WriteOnly))
+        return;
+    QJsonDocument doc;
+    doc.setObject(mCache);
+    if (file.write(doc.toJson())>=0 && file.commit())
+        mChanged = false;
+}
+
+void Settings::CompilerOutputCache::load()
+{
+    QFile file(mFilename);
+    if (!file.open(QFile::ReadOnly))
+        return;
+    QJsonParseError error;
+    QJsonDocument doc = QJsonDocument::fromJson(file.readAll(),&error);
+    if (error.error == QJsonParseError::NoError)
+        mCache = doc.object();
+    removeMissingCompilers();
+}
+
+void Settings::CompilerOutputCache::removeMissingCompilers()
+{
+    // entries of the removed compilers
+    for (auto it=mCache.begin();it!=mCache.end();) {
+        QString filename = it.value().toObject().value("file").toString();
+        if (filename.isEmpty() || !QFileInfo::exists(filename)) {
+            it = mCache.erase(it);
+            mChanged = true;
+        } else {
+            ++it;
+        }
+    }
+}
+
 const QString &Settings::CompilerSet::debugServer() const
 {
     return mDebugServer;
@@ -2335,9 +2443,10 @@ bool Settings::CompilerSet::useCustomCompileParams() const
 
 Settings::CompilerSets::CompilerSets(Settings *settings):
     mDefaultIndex(-1),
-    mSettings(settings)
+    mSettings(settings),
+    mOutputCache(includeTrailingPathDelimiter(QFileInfo(settings->filename()).path())
+                 + DEV_COMPILER_OUTPUT_CACHE_FILE)
 {
-
 }
 
 Settings::PCompilerSet Settings::CompilerSets::addSet(const Settings::CompilerSet& set)
@@ -2349,7 +2458,7 @@ Settings::PCompilerSet Settings::CompilerSets::addSet(const Settings::CompilerSe
 
 Settings::PCompilerSet Settings::CompilerSets::addSet(const QString &folder)
 {
-    PCompilerSet p=std::make_shared<CompilerSet>(folder);
+    PCompilerSet p=std::make_shared<CompilerSet>(folder,&mOutputCache);
     mList.push_back(p);
     return p;
 }
@@ -2509,6 +2618,7 @@ void Settings::CompilerSets::findSets()
 
 void Settings::CompilerSets::saveSets()
 {
+    mOutputCache.save();
     for (size_t i=0;i<mList.size();i++) {
         saveSet(i);
     }
@@ -2523,6 +2633,9 @@ void Settings::CompilerSets::saveSets()
 
 void Settings::CompilerSets::loadSets()
 {
+    auto action = finally([this]{
+        mOutputCache.save();
+    });
     mList.clear();
     mSettings->mSettings.beginGroup(SETTING_COMPILTER_SETS);
     mDefaultIndex =mSettings->mSettings.value(SETTING_COMPILTER_SETS_DEFAULT_INDEX,-1).toInt();
@@ -2754,7 +2867,7 @@ void Settings::CompilerSets::loadPathList(const QString &name, QStringList& list
 
 Settings::PCompilerSet Settings::CompilerSets::loadSet(int index)
 {
-    PCompilerSet pSet = std::make_shared<CompilerSet>();
+    PCompilerSet pSet = std::make_shared<CompilerSet>(QString(),&mOutputCache);
     mSettings->mSettings.beginGroup(QString(SETTING_COMPILTER_SET).arg(index));
 
     pSet->setCCompiler(loadPath("ccompiler"));
@@ -2835,6 +2948,9 @@ void Settings::Environment::doLoad()
     mTerminalPath = stringValue("terminal_path","/usr/bin/x-terminal-emulator");
     mAStylePath = stringValue("asyle_path","/usr/bin/astyle");
 #endif
+
+    //Performance
+    mIndexFilesForSearch = boolValue("index_files_for_search",false);
 }
 
 int Settings::Environment::interfaceFontSize() const
@@ -2907,6 +3023,16 @@ void Settings::Environment::setAStylePath(const QString &aStylePath)
     mAStylePath = aStylePath;
 }
 
+bool Settings::Environment::indexFilesForSearch() const
+{
+    return mIndexFilesForSearch;
+}
+
+void Settings::Environment::setIndexFilesForSearch(bool newIndexFilesForSearch)
+{
+    mIndexFilesForSearch = newIndexFilesForSearch;
+}
+
 void Settings::Environment::doSave()
 {
     //Appearence
@@ -2922,6 +3048,9 @@ void Settings::Environment::doSave()
     saveValue("terminal_path",mTerminalPath);
     saveValue("asyle_path",mAStylePath);
 #endif
+
+    //Performance
+    saveValue("index_files_for_search",mIndexFilesForSearch);
 }
 
 QString Settings::Environment::interfaceFont() const
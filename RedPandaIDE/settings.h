@@ -22,7 +22,9 @@
 #include <memory>
 #include <QColor>
 #include <QString>
+#include <QJsonObject>
 #include "qsynedit/SynEdit.h"
+#include "parser/parserutils.h"
 
 /**
  * use the following command to get gcc's default bin/library folders:
@@ -510,6 +512,9 @@ public:
         QString AStylePath() const;
         void setAStylePath(const QString &aStylePath);
 
+        bool indexFilesForSearch() const;
+        void setIndexFilesForSearch(bool newIndexFilesForSearch);
+
     private:
 
         //Appearence
@@ -523,6 +528,9 @@ public:
         QString mDefaultOpenFolder;
         QString mTerminalPath;
         QString mAStylePath;
+
+        //Performance
+        bool mIndexFilesForSearch;
         // _Base interface
     protected:
         void doSave() override;
@@ -1067,9 +1075,28 @@ public:
     };
 
 
+    // Outputs of the compiler probes are cached on disk, so we don't need to run
+    // the compilers every time the compiler sets are loaded.
+    // The cache entry is valid as long as the compiler's size and modified time are not changed.
+    class CompilerOutputCache {
+    public:
+        explicit CompilerOutputCache(const QString& filename);
+        QByteArray getOutput(const QString& binDir, const QString& binFile,
+                             const QStringList& arguments);
+        void save();
+    private:
+        void load();
+        void removeMissingCompilers();
+    private:
+        QString mFilename;
+        QJsonObject mCache;
+        bool mChanged;
+    };
+
     class CompilerSet {
     public:
-        explicit CompilerSet(const QString& compilerFolder = QString());
+        explicit CompilerSet(const QString& compilerFolder = QString(),
+                             CompilerOutputCache* outputCache = nullptr);
         explicit CompilerSet(const CompilerSet& set);
 
         CompilerSet& operator= (const CompilerSet& ) = delete;
@@ -1124,6 +1151,8 @@ public:
         const QString& name() const;
         void setName(const QString& value);
         const QStringList& defines() const;
+        // defines parsed by the preprocessor, shared by all the parsers
+        PDefineMap parsedDefines();
         const QString& target() const;
         void setTarget(const QString& value);
 
@@ -1195,6 +1224,7 @@ public:
         QString mType; // "TDM-GCC", "MinGW"
         QString mName; // "TDM-GCC 4.7.1 Release"
         QStringList mDefines; // list of predefined constants
+        PDefineMap mParsedDefines; // parsed predefined constants, created when first used
         QString mTarget; // 'X86_64' / 'i686'
         QString mCompilerType; // 'Clang' / 'GCC'
         int mCompilerSetType; // RELEASE/ DEBUG/ Profile
@@ -1209,6 +1239,9 @@ public:
 
         // Options
         CompilerOptionList mOptions;
+
+        // owned by the compiler sets, nullptr if the outputs are not cached
+        CompilerOutputCache* mOutputCache;
     };
 
     typedef std::shared_ptr<CompilerSet> PCompilerSet;
@@ -1246,6 +1279,7 @@ public:
         CompilerSetList mList;
         int mDefaultIndex;
         Settings* mSettings;
+        CompilerOutputCache mOutputCache;
     };
 
 public:
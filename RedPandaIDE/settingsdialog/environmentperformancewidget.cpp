@@ -17,6 +17,7 @@
 #include "environmentperformancewidget.h"
 #include "ui_environmentperformancewidget.h"
 #include "../settings.h"
+#include "../mainwindow.h"
 
 EnvironmentPerformanceWidget::EnvironmentPerformanceWidget(const QString& name, const QString& group, QWidget *parent) :
     SettingsWidget(name,group,parent),
@@ -45,11 +46,16 @@ void EnvironmentPerformanceWidget::doLoad()
         pSettings->codeCompletion().setClearWhenEditorHidden(true);
     }
 #endif
+    ui->chkIndexFilesForSearch->setChecked(pSettings->environment().indexFilesForSearch());
 }
 
 void EnvironmentPerformanceWidget::doSave()
 {
     pSettings->codeCompletion().setClearWhenEditorHidden(ui->chkClearWhenEditorHidden->isChecked());
 
+    pSettings->environment().setIndexFilesForSearch(ui->chkIndexFilesForSearch->isChecked());
+
     pSettings->codeCompletion().save();
+    pSettings->environment().save();
+    pMainWindow->updateSearchIndex();
 }
@@ -71,6 +71,9 @@
 #define DEV_BOOKMARK_FILE "bookmarks.json"
 #define DEV_BREAKPOINTS_FILE "breakpoints.json"
 #define DEV_WATCH_FILE "watch.json"
+#define DEV_COMPILER_OUTPUT_CACHE_FILE "compileroutputs.json"
+#define DEV_SEARCH_INDEX_DIR "searchindex"
+#define LARGE_FILE_SIZE_THRESHOLD (64*1024*1024) // files bigger than this are mapped and opened read-only
 
 #ifdef Q_OS_WIN
 #   define PATH_SENSITIVITY Qt::CaseInsensitive
@@ -31,12 +31,15 @@
 #include <QDateTime>
 #include <QColor>
 #include <QDesktopWidget>
+#include <cstring>
+#include <climits>
 #include "parser/cppparser.h"
 #include "settings.h"
 #include "mainwindow.h"
 #include "editorlist.h"
 #include "editor.h"
 #include "project.h"
+#include "platform.h"
 #include "version.h"
 #include "compiler/executablerunner.h"
 #ifdef Q_OS_WIN
@@ -90,11 +93,65 @@ const QByteArray GuessTextEncoding(const QByteArray& text){
     return ENCODING_UTF8;
 }
 
+//returns the position of the first non-ascii byte from start, checking 8 bytes at a time
+static qint64 skipAscii(const uchar* data, qint64 start, qint64 size)
+{
+    qint64 i = start;
+    while (i+8<=size) {
+        quint64 word;
+        memcpy(&word,data+i,8);
+        if (word & 0x8080808080808080ULL)
+            break;
+        i+=8;
+    }
+    while (i<size && data[i]<0x80)
+        i++;
+    return i;
+}
+
 bool isTextAllAscii(const QByteArray& text) {
-    for (char c:text) {
-        if (c<0) {
+    return skipAscii(reinterpret_cast<const uchar*>(text.constData()),0,text.length())
+            == text.length();
+}
+
+bool isTextValidUTF8(const char *data, qint64 size, bool &allAscii)
+{
+    const uchar* p = reinterpret_cast<const uchar*>(data);
+    allAscii = true;
+    qint64 i = 0;
+    while (true) {
+        i = skipAscii(p,i,size);
+        if (i>=size)
+            break;
+        allAscii = false;
+        uchar c = p[i];
+        int n;
+        quint32 codePoint;
+        if (c>=0xC2 && c<=0xDF) {
+            n = 1;
+            codePoint = c & 0x1F;
+        } else if ((c & 0xF0) == 0xE0) {
+            n = 2;
+            codePoint = c & 0x0F;
+        } else if (c>=0xF0 && c<=0xF4) {
+            n = 3;
+            codePoint = c & 0x07;
+        } else
             return false;
+        if (i+n>=size)
+            return false;
+        for (int k=1;k<=n;k++) {
+            uchar trail = p[i+k];
+            if ((trail & 0xC0)!=0x80)
+                return false;
+            codePoint = (codePoint << 6) | (trail & 0x3F);
         }
+        //overlong forms, surrogates and code points beyond unicode
+        if (n==2 && (codePoint<0x800 || (codePoint>=0xD800 && codePoint<=0xDFFF)))
+            return false;
+        if (n==3 && (codePoint<0x10000 || codePoint>0x10FFFF))
+            return false;
+        i+=n+1;
     }
     return true;
 }
@@ -381,6 +438,105 @@ void readFileToLines(const QString &fileName, QTextCodec *codec, LineProcessFunc
     }
 }
 
+bool readTextFile(const QString &fileName, const QByteArray &encoding, QString &text,
+                  QByteArray &realEncoding, int &invalidChars)
+{
+    text.clear();
+    realEncoding = encoding;
+    invalidChars = 0;
+    QFile file(fileName);
+    if (!file.open(QFile::ReadOnly))
+        return false;
+    qint64 size = file.size();
+    if (size > INT_MAX)
+        return false;
+    if (size == 0) {
+        if (encoding == ENCODING_AUTO_DETECT)
+            realEncoding = ENCODING_ASCII;
+        return true;
+    }
+    // a mapping saves copying the whole file, fall back to reading it
+    uchar* mapped = file.map(0,size);
+    auto action = finally([&file,mapped]{
+        if (mapped)
+            file.unmap(mapped);
+    });
+    QByteArray content;
+    const char* data;
+    if (mapped) {
+        data = reinterpret_cast<const char*>(mapped);
+    } else {
+        content = file.readAll();
+        if (content.length()!=size)
+            return false;
+        data = content.constData();
+    }
+    bool hasBOM = (size>=3) && ((unsigned char)data[0]==0xEF)
+            && ((unsigned char)data[1]==0xBB) && ((unsigned char)data[2]==0xBF);
+    int start = 0;
+    if (encoding == ENCODING_AUTO_DETECT) {
+        if (hasBOM)
+            start = 3;
+        bool allAscii = false;
+        if (isTextValidUTF8(data+start,size-start,allAscii)) {
+            if (hasBOM)
+                realEncoding = ENCODING_UTF8_BOM;
+            else if (allAscii)
+                realEncoding = ENCODING_ASCII;
+            else
+                realEncoding = ENCODING_UTF8;
+        } else {
+            realEncoding = ENCODING_SYSTEM_DEFAULT;
+            start = 0;
+        }
+    } else if (encoding == ENCODING_UTF8_BOM && hasBOM) {
+        start = 3;
+    }
+    if (realEncoding == ENCODING_ASCII) {
+        if (encoding != ENCODING_AUTO_DETECT)
+            invalidChars = size - skipAscii(reinterpret_cast<const uchar*>(data),0,size);
+        text = QString::fromLatin1(data,size);
+        return true;
+    }
+    if (realEncoding == ENCODING_SYSTEM_DEFAULT)
+        realEncoding = pCharsetInfoManager->getDefaultSystemEncoding();
+    QTextCodec* codec = QTextCodec::codecForName(
+                realEncoding == ENCODING_UTF8_BOM ? ENCODING_UTF8 : realEncoding);
+    if (!codec)
+        return false;
+    // keep the byte order marks we haven't skipped, so the text can be written back as is
+    QTextCodec::ConverterState state(QTextCodec::IgnoreHeader);
+    text = codec->toUnicode(data+start,size-start,&state);
+    invalidChars = state.invalidChars;
+    return true;
+}
+
+bool readTextFileToLines(const QString &fileName, const QByteArray &encoding, QStringList &lines)
+{
+    QString text;
+    QByteArray realEncoding;
+    int invalidChars;
+    if (!readTextFile(fileName,encoding,text,realEncoding,invalidChars))
+        return false;
+    lines.clear();
+    splitTextToLines(text,lines);
+    return true;
+}
+
+void splitTextToLines(const QString &text, QStringList &lines, QVector<int> *lineStarts)
+{
+    int pos = 0;
+    while (pos < text.length()) {
+        int lineEnd = text.indexOf('\n',pos);
+        if (lineEnd<0)
+            lineEnd = text.length();
+        if (lineStarts)
+            lineStarts->append(pos);
+        lines.append(trimRight(text.mid(pos,lineEnd-pos)));
+        pos = lineEnd+1;
+    }
+}
+
 BaseError::BaseError(const QString &reason):
 mReason(reason)
 {
@@ -616,10 +772,8 @@ void resetCppParser(std::shared_ptr<CppParser> parser)
             parser->addIncludePath(file);
         }
         //TODO: Add default include dirs last, just like gcc does
-        // Set defines
-        for (QString define:compilerSet->defines()) {
-            parser->addHardDefineByLine(define); // predefined constants from -dM -E
-        }
+        // Set defines (predefined constants from -dM -E, parsed once and shared by all parsers)
+        parser->addHardDefines(compilerSet->parsedDefines());
         // add a dev-cpp's own macro
         parser->addHardDefineByLine("#define EGE_FOR_AUTO_CODE_COMPLETETION_ONLY");
         // add C/C++ default macro
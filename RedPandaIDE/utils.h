@@ -22,6 +22,7 @@
 #include <QString>
 #include <QRect>
 #include <QStringList>
+#include <QVector>
 #include <memory>
 #include <QThread>
 #include <QProcessEnvironment>
@@ -133,6 +134,11 @@ const QByteArray GuessTextEncoding(const QByteArray& text);
 
 bool isTextAllAscii(const QByteArray& text);
 bool isTextAllAscii(const QString& text);
+/*
+ * Checks in one pass if data is well-formed utf8.
+ * allAscii is set to true if there are no non-ascii bytes.
+ */
+bool isTextValidUTF8(const char* data, qint64 size, bool& allAscii);
 
 QByteArray runAndGetOutput(const QString& cmd, const QString& workingDir, const QStringList& arguments,
                            const QByteArray& inputContent = QByteArray(),
@@ -178,6 +184,20 @@ QStringList readFileToLines(const QString& fileName, QTextCodec* codec);
 QStringList readFileToLines(const QString& fileName);
 QByteArray readFileToByteArray(const QString& fileName);
 void readFileToLines(const QString& fileName, QTextCodec* codec, LineProcessFunc lineFunc);
+/*
+ * Reads and decodes a text file like the editor does, without creating an editor buffer,
+ * so it's safe to use in worker threads.
+ * encoding is a codec name or ENCODING_AUTO_DETECT, realEncoding is set to the encoding used.
+ * invalidChars is set to the count of bytes that can't be decoded in that encoding.
+ */
+bool readTextFile(const QString& fileName, const QByteArray& encoding, QString& text,
+                  QByteArray& realEncoding, int& invalidChars);
+bool readTextFileToLines(const QString& fileName, const QByteArray& encoding, QStringList& lines);
+/*
+ * Splits the text to lines like the editor does (trailing spaces are trimmed).
+ * lineStarts is set to the positions of the lines in the text.
+ */
+void splitTextToLines(const QString& text, QStringList& lines, QVector<int>* lineStarts = nullptr);
 void stringsToFile(const QStringList& list, const QString& fileName);
 void stringToFile(const QString& str, const QString& fileName);
 
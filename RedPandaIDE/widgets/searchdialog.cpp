@@ -23,6 +23,7 @@
 #include "../qsynedit/Search.h"
 #include "../qsynedit/SearchRegex.h"
 #include "../project.h"
+#include "../filesearcher.h"
 #include <QMessageBox>
 #include <QDebug>
 
@@ -278,95 +279,31 @@ void SearchDialog::on_btnExecute_clicked()
         }
 
     } else if (actionType == SearchAction::FindFiles || actionType == SearchAction::ReplaceFiles) {
-        int fileSearched = 0;
-        int fileHitted = 0;
+        // the files are searched in background, without opening them in editors
         QString keyword = ui->cbFind->currentText();
+        QStringList files;
+        SearchFileScope scope;
         if (ui->rbOpenFiles->isChecked()) {
-            PSearchResults results = pMainWindow->searchResultModel()->addSearchResults(
-                        keyword,
-                        mSearchOptions,
-                        SearchFileScope::openedFiles
-                        );
-            // loop through editors, add results to message control
+            scope = SearchFileScope::openedFiles;
             for (int i=0;i<pMainWindow->editorList()->pageCount();i++) {
                 Editor * e=pMainWindow->editorList()->operator[](i);
-                if (e!=nullptr) {
-                    fileSearched++;
-                    PSearchResultTreeItem parentItem = batchFindInEditor(
-                                e,
-                                e->filename(),
-                                keyword);
-                    int t = parentItem->results.size();
-                    findCount+=t;
-                    if (t>0) {
-                        fileHitted++;
-                        results->results.append(parentItem);
-                    }
-                }
+                if (e!=nullptr)
+                    files.append(e->filename());
             }
-            pMainWindow->searchResultModel()->notifySearchResultsUpdated();
         } else if (ui->rbCurrentFile->isChecked()) {
-            PSearchResults results = pMainWindow->searchResultModel()->addSearchResults(
-                        keyword,
-                        mSearchOptions,
-                        SearchFileScope::currentFile
-                        );
+            scope = SearchFileScope::currentFile;
             Editor * e= pMainWindow->editorList()->getEditor();
-            if (e!=nullptr) {
-                fileSearched++;
-                PSearchResultTreeItem parentItem = batchFindInEditor(
-                            e,
-                            e->filename(),
-                            keyword);
-                int t = parentItem->results.size();
-                findCount+=t;
-                if (t>0) {
-                    fileHitted++;
-                    results->results.append(parentItem);
-                }
-            }
-            pMainWindow->searchResultModel()->notifySearchResultsUpdated();
+            if (e!=nullptr)
+                files.append(e->filename());
         } else if (ui->rbProject->isChecked()) {
-            PSearchResults results = pMainWindow->searchResultModel()->addSearchResults(
-                        keyword,
-                        mSearchOptions,
-                        SearchFileScope::wholeProject
-                        );
+            scope = SearchFileScope::wholeProject;
             for (int i=0;i<pMainWindow->project()->units().count();i++) {
-                Editor * e = pMainWindow->project()->units()[i]->editor();
-                QString curFilename =  pMainWindow->project()->units()[i]->fileName();
-                if (e) {
-                    fileSearched++;
-                    PSearchResultTreeItem parentItem = batchFindInEditor(
-                                e,
-                                e->filename(),
-                                keyword);
-                    int t = parentItem->results.size();
-                    findCount+=t;
-                    if (t>0) {
-                        fileHitted++;
-                        results->results.append(parentItem);
-                    }
-                } else if (fileExists(curFilename)) {
-                    SynEdit editor;
-                    QByteArray realEncoding;
-                    editor.lines()->loadFromFile(curFilename,ENCODING_AUTO_DETECT, realEncoding);
-                    fileSearched++;
-                    PSearchResultTreeItem parentItem = batchFindInEditor(
-                                &editor,
-                                curFilename,
-                                keyword);
-                    int t = parentItem->results.size();
-                    findCount+=t;
-                    if (t>0) {
-                        fileHitted++;
-                        results->results.append(parentItem);
-                    }
-
-                }
+                files.append(pMainWindow->project()->units()[i]->fileName());
             }
-            pMainWindow->searchResultModel()->notifySearchResultsUpdated();
+        } else {
+            return;
         }
+        pMainWindow->fileSearcher()->findInFiles(keyword, mSearchOptions, scope, files);
         pMainWindow->showSearchPanel(actionType == SearchAction::ReplaceFiles);
     }
 }
@@ -396,45 +333,6 @@ int SearchDialog::execute(SynEdit *editor, const QString &sSearch, const QString
                           mSearchEngine, matchCallback);
 }
 
-std::shared_ptr<SearchResultTreeItem> SearchDialog::batchFindInEditor(SynEdit *e, const QString& filename,const QString &keyword)
-{
-    //backup
-    BufferCoord caretBackup = e->caretXY();
-    BufferCoord blockBeginBackup = e->blockBegin();
-    BufferCoord blockEndBackup = e->blockEnd();
-    int toplineBackup = e->topLine();
-    int leftCharBackup = e->leftChar();
-
-    PSearchResultTreeItem parentItem = std::make_shared<SearchResultTreeItem>();
-    parentItem->filename = filename;
-    parentItem->parent = nullptr;
-    execute(e,keyword,"",
-                    [e,&parentItem, filename](const QString&,
-                    const QString&, int Line, int ch, int wordLen){
-        PSearchResultTreeItem item = std::make_shared<SearchResultTreeItem>();
-        item->filename = filename;
-        item->line = Line;
-        item->start = ch;
-        item->len = wordLen;
-        item->parent = parentItem.get();
-        item->text = e->lines()->getString(Line-1);
-        item->text.replace('\t',' ');
-        parentItem->results.append(item);
-        return SynSearchAction::Skip;
-    });
-
-    // restore
-    e->setCaretXY(caretBackup);
-    e->setTopLine(toplineBackup);
-    e->setLeftChar(leftCharBackup);
-    e->setCaretAndSelection(
-                caretBackup,
-                blockBeginBackup,
-                blockEndBackup
-                );
-    return parentItem;
-}
-
 QTabBar *SearchDialog::tabBar() const
 {
     return mTabBar;
@@ -25,7 +25,6 @@ namespace Ui {
 class SearchDialog;
 }
 
-struct SearchResultTreeItem;
 class QTabBar;
 class Editor;
 class SearchDialog : public QDialog
@@ -62,7 +61,6 @@ private slots:
 private:
    int execute(SynEdit* editor, const QString& sSearch,
                const QString& sReplace, SynSearchMathedProc matchCallback = nullptr);
-   std::shared_ptr<SearchResultTreeItem> batchFindInEditor(SynEdit * editor,const QString& filename, const QString& keyword);
 private:
     Ui::SearchDialog *ui;
     QTabBar *mTabBar;
@@ -57,6 +57,8 @@ struct SearchResults{
 
 using PSearchResults = std::shared_ptr<SearchResults>;
 
+Q_DECLARE_METATYPE(PSearchResultTreeItemList);
+
 class SearchResultModel : public QObject {
     Q_OBJECT
 public:
@@ -0,0 +1,31 @@
+# Times SynEditStringList::loadFromFile on generated multi-MB files.
+# The text buffer depends on the IDE's utils and settings, so the tool is built
+# from the IDE's sources with its own main().
+
+IDE_DIR = $$PWD/../../RedPandaIDE
+include($$IDE_DIR/RedPandaIDE.pro)
+
+# the IDE's file lists are relative to its own directory
+IDE_SOURCES = $$SOURCES
+IDE_SOURCES -= main.cpp
+IDE_HEADERS = $$HEADERS
+IDE_FORMS = $$FORMS
+SOURCES =
+HEADERS =
+FORMS =
+for(file, IDE_SOURCES): SOURCES += $$IDE_DIR/$$file
+for(file, IDE_HEADERS): HEADERS += $$IDE_DIR/$$file
+for(file, IDE_FORMS): FORMS += $$IDE_DIR/$$file
+SOURCES += main.cpp
+
+INCLUDEPATH += $$IDE_DIR
+
+TARGET = LoadBenchmark
+CONFIG += console
+CONFIG -= app_bundle
+
+# the benchmark doesn't need the IDE's resources, translations and installation
+RESOURCES =
+TRANSLATIONS =
+RC_ICONS =
+INSTALLS =
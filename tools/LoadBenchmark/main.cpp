@@ -0,0 +1,181 @@
+/*
+ * Copyright (C) 2020-2022 Roy Qu (royqh1979@gmail.com)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Times SynEditStringList::loadFromFile on generated multi-MB sources
+ * (ascii, utf8 and a legacy encoding), and compares it with reading the
+ * same files line by line through QTextStream.
+ *
+ * usage: LoadBenchmark [size in MB (default 8)] [runs (default 5)]
+ */
+
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QTemporaryDir>
+#include <QTextCodec>
+#include <QTextStream>
+#include <cstdio>
+#include <functional>
+#include "qsynedit/TextBuffer.h"
+#include "platform.h"
+#include "utils.h"
+
+struct BenchmarkInput {
+    QString name;
+    QString filename;
+    QByteArray encoding; // encoding passed to loadFromFile
+    QByteArray codecName; // codec used to write the file and to read it by QTextStream
+};
+
+static QString generateText(qint64 size, bool nonAscii)
+{
+    QStringList block;
+    block.append("#include <stdio.h>");
+    block.append("");
+    block.append("static int compute(int* values, int count)");
+    block.append("{");
+    if (nonAscii)
+        block.append("    // 计算所有元素的和 (sum of all values)");
+    else
+        block.append("    // sum of all values");
+    block.append("    int sum = 0;");
+    block.append("    for (int i=0;i<count;i++) {");
+    block.append("        sum += values[i];");
+    block.append("    }");
+    if (nonAscii)
+        block.append("    printf(\"结果: %d\\n\", sum);");
+    else
+        block.append("    printf(\"result: %d\\n\", sum);");
+    block.append("    return sum;");
+    block.append("}");
+    block.append("");
+    QString blockText = block.join("\n") + "\n";
+    QString text;
+    text.reserve(size+blockText.length());
+    while (text.length() < size)
+        text.append(blockText);
+    return text;
+}
+
+static bool writeInput(const BenchmarkInput& input, const QString& text)
+{
+    QTextCodec* codec = QTextCodec::codecForName(input.codecName);
+    if (!codec)
+        return false;
+    QFile file(input.filename);
+    if (!file.open(QFile::WriteOnly | QFile::Truncate))
+        return false;
+    return file.write(codec->fromUnicode(text)) >= 0;
+}
+
+// the best and average time of the runs, in ms
+static void timeRuns(int runs, std::function<int()> run, double& best, double& average, int& lineCount)
+{
+    best = -1;
+    double total = 0;
+    for (int i=0;i<runs;i++) {
+        QElapsedTimer timer;
+        timer.start();
+        lineCount = run();
+        double elapsed = timer.nsecsElapsed()/1000000.0;
+        total += elapsed;
+        if (best<0 || elapsed<best)
+            best = elapsed;
+    }
+    average = total/runs;
+}
+
+static void printResult(const QString& name, const QString& method, qint64 fileSize,
+                        double best, double average, int lineCount)
+{
+    double mb = fileSize/(1024.0*1024.0);
+    printf("%-16s %-22s %8.2f MB %9d lines %9.1f ms best %9.1f ms avg %8.1f MB/s\n",
+           name.toLocal8Bit().constData(),
+           method.toLocal8Bit().constData(),
+           mb, lineCount, best, average,
+           best>0 ? mb*1000/best : 0.0);
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    int sizeInMB = 8;
+    int runs = 5;
+    if (argc>1)
+        sizeInMB = std::max(1,QString(argv[1]).toInt());
+    if (argc>2)
+        runs = std::max(1,QString(argv[2]).toInt());
+
+    pCharsetInfoManager = new CharsetInfoManager();
+    auto action = finally([]{
+        delete pCharsetInfoManager;
+    });
+
+    QTemporaryDir dir;
+    if (!dir.isValid()) {
+        fprintf(stderr,"Can't create the temporary dir.\n");
+        return 1;
+    }
+    QList<BenchmarkInput> inputs{
+        {"ascii", dir.filePath("ascii.c"), ENCODING_AUTO_DETECT, "UTF-8"},
+        {"utf8", dir.filePath("utf8.c"), ENCODING_AUTO_DETECT, "UTF-8"},
+        {"gbk", dir.filePath("gbk.c"), "GBK", "GBK"},
+        {"gbk (detected)", dir.filePath("gbk.c"), ENCODING_AUTO_DETECT, "GBK"},
+    };
+    qint64 size = (qint64)sizeInMB*1024*1024;
+    QString asciiText = generateText(size,false);
+    QString nonAsciiText = generateText(size,true);
+    for (const BenchmarkInput& input:inputs) {
+        if (QFile::exists(input.filename))
+            continue;
+        if (!writeInput(input, input.name=="ascii"? asciiText : nonAsciiText)) {
+            fprintf(stderr,"Can't write '%s'.\n",input.filename.toLocal8Bit().constData());
+            return 1;
+        }
+    }
+    asciiText.clear();
+    nonAsciiText.clear();
+
+    for (const BenchmarkInput& input:inputs) {
+        qint64 fileSize = QFileInfo(input.filename).size();
+        double best, average;
+        int lineCount;
+        QByteArray realEncoding;
+        timeRuns(runs,[&input,&realEncoding]() {
+            SynEditStringList lines(nullptr);
+            lines.loadFromFile(input.filename,input.encoding,realEncoding);
+            return lines.count();
+        },best,average,lineCount);
+        printResult(input.name,
+                    QString("loadFromFile(%1)").arg(QString(realEncoding)),
+                    fileSize,best,average,lineCount);
+
+        timeRuns(runs,[&input]() {
+            QFile file(input.filename);
+            if (!file.open(QFile::ReadOnly))
+                return 0;
+            QTextStream stream(&file);
+            stream.setCodec(input.codecName);
+            stream.setAutoDetectUnicode(false);
+            return readStreamToLines(&stream).count();
+        },best,average,lineCount);
+        printResult(input.name,"QTextStream lines",fileSize,best,average,lineCount);
+    }
+    return 0;
+}